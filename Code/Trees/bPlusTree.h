@@ -0,0 +1,788 @@
+//
+// bPlusTree.h
+//      an ordered map kept in a B+-tree, offered alongside RedBlackTree
+//
+// A binary tree reads one key per cache line on its way down; for large trees nearly
+// every level is a cache miss. Here a node holds up to 32 keys, so a search visits a
+// handful of nodes and reads their keys sequentially. Pairs live only in the leaves,
+// which are chained left to right for in-order walks. An inner node keeps, for each
+// child, the number of pairs below it, which gives rank and select in O(log n).
+//
+// Within a node, finding a key's position is a count of the keys less than it. For
+// uint64_t keys that count is done four keys at a time with AVX2 (or two at a time with
+// SSE4.2) compare and movemask when the compiler targets them (-mavx2, -msse4.2 or
+// -march=native); other key types and targets use a plain loop, which compilers
+// vectorize well on their own.
+//
+// Insertion splits full nodes, and removal tops up minimal ones, on the way down, so
+// both are single top-down passes. Pairs move between nodes when they split, merge or
+// borrow, so a reference returned by operator[] or search() is only good until the
+// next insert or remove.
+//
+
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+static const uint32_t
+    BPT_NODE_SIZE = 32,                 // pairs per leaf, children per inner node
+    BPT_MIN_SIZE = BPT_NODE_SIZE / 2,   // least a node other than the root may hold
+    BPT_MAX_DEPTH = 16;                 // far more than 2^32 pairs can need
+
+template <typename KeyType,typename ValueType>
+class BPlusTree {
+public:
+    BPlusTree() {
+
+        root = nullptr;
+        nPairs = 0;
+    }
+
+    ~BPlusTree() { prvClear(root); }
+
+    BPlusTree(const BPlusTree &) = delete;
+    BPlusTree &operator=(const BPlusTree &) = delete;
+
+    void clear() {
+
+        prvClear(root);
+        root = nullptr;
+        nPairs = 0;
+    }
+
+    uint32_t size() { return nPairs; }
+
+    bool isEmpty() { return nPairs == 0; }
+
+    // number of levels, leaves included
+    uint32_t height() {
+        uint32_t
+            h = 0;
+
+        for (Node *node=root;node!=nullptr;node=node->isLeaf ? nullptr : prvInner(node)->children[0])
+            h++;
+
+        return h;
+    }
+
+    ValueType &search(const KeyType &k) {
+        Node
+            *node = root;
+        uint32_t
+            pos;
+
+        if (node == nullptr)
+            throw std::domain_error("Search: Key not found");
+
+        while (!node->isLeaf)
+            node = prvInner(node)->children[prvChildIndex(prvInner(node),k)];
+
+        Leaf
+            *leaf = prvLeaf(node);
+
+        pos = prvCountBelow<false>(leaf->keys,leaf->n,k);
+        if (pos == leaf->n || !(leaf->keys[pos] == k))
+            throw std::domain_error("Search: Key not found");
+
+        return leaf->values[pos];
+    }
+
+    // the value for k, inserting k with a value-initialized value if needed
+    ValueType &operator[](const KeyType &k) {
+        Inner
+            *path[BPT_MAX_DEPTH];
+        uint32_t
+            idx[BPT_MAX_DEPTH],
+            depth = 0,
+            i,
+            pos;
+        Node
+            *node;
+
+        if (root == nullptr)
+            root = prvNewLeaf();
+
+        // a full root splits under a new root, which is how the tree grows taller
+        if (prvIsFull(root)) {
+            Inner
+                *newRoot = prvNewInner();
+
+            newRoot->n = 1;
+            newRoot->children[0] = root;
+            newRoot->counts[0] = nPairs;
+            root = newRoot;
+            prvSplitChild(newRoot,0);
+        }
+
+        // split any full child before stepping into it, so there is always room
+        // for the node below to split into
+        for (node=root;!node->isLeaf;node=path[depth-1]->children[i]) {
+            Inner
+                *inner = prvInner(node);
+
+            i = prvChildIndex(inner,k);
+            if (prvIsFull(inner->children[i])) {
+                prvSplitChild(inner,i);
+                if (!(k < inner->keys[i]))
+                    i++;
+            }
+
+            path[depth] = inner;
+            idx[depth++] = i;
+        }
+
+        Leaf
+            *leaf = prvLeaf(node);
+
+        pos = prvCountBelow<false>(leaf->keys,leaf->n,k);
+        if (pos < leaf->n && leaf->keys[pos] == k)
+            return leaf->values[pos];
+
+        std::move_backward(leaf->keys + pos,leaf->keys + leaf->n,leaf->keys + leaf->n + 1);
+        std::move_backward(leaf->values + pos,leaf->values + leaf->n,leaf->values + leaf->n + 1);
+        leaf->keys[pos] = k;
+        leaf->values[pos] = ValueType();
+        leaf->n++;
+
+        nPairs++;
+        for (uint32_t d=0;d<depth;d++)
+            path[d]->counts[idx[d]]++;
+
+        return leaf->values[pos];
+    }
+
+    void remove(const KeyType &k) {
+        Inner
+            *path[BPT_MAX_DEPTH];
+        uint32_t
+            idx[BPT_MAX_DEPTH],
+            depth = 0,
+            i,
+            pos;
+        Node
+            *node;
+
+        if (root == nullptr)
+            throw std::domain_error("Remove: Key not found");
+
+        // top up any minimal child before stepping into it, so the leaf can spare a
+        // pair and every node on the way can spare a child
+        for (node=root;!node->isLeaf;node=path[depth-1]->children[i]) {
+            Inner
+                *inner = prvInner(node);
+
+            i = prvChildIndex(inner,k);
+            if (prvIsMinimal(inner->children[i]))
+                i = prvFillChild(inner,i);
+
+            path[depth] = inner;
+            idx[depth++] = i;
+        }
+
+        Leaf
+            *leaf = prvLeaf(node);
+
+        pos = prvCountBelow<false>(leaf->keys,leaf->n,k);
+        if (pos == leaf->n || !(leaf->keys[pos] == k)) {
+            // the descent may have merged the root's last two children
+            prvShrinkRoot();
+            throw std::domain_error("Remove: Key not found");
+        }
+
+        std::move(leaf->keys + pos + 1,leaf->keys + leaf->n,leaf->keys + pos);
+        std::move(leaf->values + pos + 1,leaf->values + leaf->n,leaf->values + pos);
+        leaf->n--;
+
+        nPairs--;
+        for (uint32_t d=0;d<depth;d++)
+            path[d]->counts[idx[d]]--;
+
+        prvShrinkRoot();
+    }
+
+    //
+    // order statistics, all O(log n) using the per-child counts
+    //
+
+    // position of k in sorted order
+    uint32_t rank(const KeyType &k) {
+        uint32_t
+            pos,
+            j;
+        Leaf
+            *leaf;
+
+        if (root == nullptr)
+            throw std::domain_error("Rank: Key not found");
+
+        pos = prvCountBefore(k,leaf);
+        j = prvCountBelow<false>(leaf->keys,leaf->n,k);
+        if (j == leaf->n || !(leaf->keys[j] == k))
+            throw std::domain_error("Rank: Key not found");
+
+        return pos + j;
+    }
+
+    // key at position i in sorted order
+    const KeyType &select(uint32_t i) {
+        Node
+            *node = root;
+
+        if (i >= nPairs)
+            throw std::out_of_range("Select: Index " + std::to_string(i) + " is out of range");
+
+        while (!node->isLeaf) {
+            Inner
+                *inner = prvInner(node);
+            uint32_t
+                c = 0;
+
+            while (i >= inner->counts[c])
+                i -= inner->counts[c++];
+
+            node = inner->children[c];
+        }
+
+        return prvLeaf(node)->keys[i];
+    }
+
+    // number of keys less than k
+    uint32_t countLess(const KeyType &k) { return prvCountUpTo<false>(k); }
+
+    // number of keys in [lo,hi]
+    uint32_t countRange(const KeyType &lo,const KeyType &hi) {
+
+        if (hi < lo)
+            return 0;
+
+        return prvCountUpTo<true>(hi) - prvCountUpTo<false>(lo);
+    }
+
+    //
+    // visit every pair in key order, along the leaf chain. visit can be any callable
+    // taking (const KeyType &,ValueType &)
+    //
+
+    template <typename Visitor>
+    void map(Visitor &&visit) {
+
+        mapWhile([&visit](const KeyType &k,ValueType &v) { visit(k,v); return true; });
+    }
+
+    // as map(), but stop as soon as visit returns false; true if every pair was visited
+    template <typename Visitor>
+    bool mapWhile(Visitor &&visit) {
+        Node
+            *node = root;
+
+        if (node == nullptr)
+            return true;
+
+        while (!node->isLeaf)
+            node = prvInner(node)->children[0];
+
+        for (Leaf *leaf=prvLeaf(node);leaf!=nullptr;leaf=leaf->next)
+            for (uint32_t i=0;i<leaf->n;i++)
+                if (!visit(leaf->keys[i],leaf->values[i]))
+                    return false;
+
+        return true;
+    }
+
+    // check ordering, separators, occupancy, counts, leaf depth and the leaf chain;
+    // throws logic_error describing the first problem found
+    void isValidBPlusTree() {
+        uint32_t
+            leafDepth = 0,
+            chained = 0;
+        bool
+            first = true;
+        KeyType
+            prev = KeyType();
+
+        if (root == nullptr) {
+            if (nPairs != 0)
+                throw std::logic_error("empty tree with nonzero size");
+            return;
+        }
+
+        if (prvCheck(root,1,leafDepth,nullptr,nullptr) != nPairs)
+            throw std::logic_error("size does not match the pairs in the tree");
+
+        map([&](const KeyType &k,ValueType &) {
+            if (!first && !(prev < k))
+                throw std::logic_error("leaf chain out of order");
+            prev = k;
+            first = false;
+            chained++;
+        });
+
+        if (chained != nPairs)
+            throw std::logic_error("leaf chain misses pairs");
+    }
+
+private:
+    // keys is shared by both kinds of node: a leaf's n keys, or the n-1 separators
+    // between an inner node's n children. separator i-1 is a lower bound for every key
+    // under child i, and an upper bound (exclusive) for every key under child i-1
+    struct Node {
+        alignas(32) KeyType
+            keys[BPT_NODE_SIZE];
+        uint32_t
+            n;
+        bool
+            isLeaf;
+    };
+
+    struct Leaf : Node {
+        ValueType
+            values[BPT_NODE_SIZE];
+        Leaf
+            *next;
+    };
+
+    struct Inner : Node {
+        Node
+            *children[BPT_NODE_SIZE];
+        uint32_t
+            counts[BPT_NODE_SIZE];      // pairs under each child
+    };
+
+    static Leaf *prvLeaf(Node *node) { return static_cast<Leaf *>(node); }
+    static Inner *prvInner(Node *node) { return static_cast<Inner *>(node); }
+
+    static Leaf *prvNewLeaf() {
+        Leaf
+            *leaf = new Leaf;
+
+        leaf->n = 0;
+        leaf->isLeaf = true;
+        leaf->next = nullptr;
+
+        return leaf;
+    }
+
+    static Inner *prvNewInner() {
+        Inner
+            *inner = new Inner;
+
+        inner->n = 0;
+        inner->isLeaf = false;
+
+        return inner;
+    }
+
+    static bool prvIsFull(Node *node) { return node->n == BPT_NODE_SIZE; }
+    static bool prvIsMinimal(Node *node) { return node->n <= BPT_MIN_SIZE; }
+
+    //
+    // how many of the first n keys are less than k (orEqual: not greater than k).
+    // with AVX2 the keys are compared four at a time; the sign bit is flipped on both
+    // sides because the hardware compare is signed. lanes past n are masked off, so
+    // stale keys there do no harm
+    //
+
+    template <bool orEqual>
+    static uint32_t prvCountBelow(const KeyType *keys,uint32_t n,const KeyType &k) {
+        uint32_t
+            count = 0;
+
+#if defined(__AVX2__)
+        if constexpr (std::is_same<KeyType,uint64_t>::value) {
+            const __m256i
+                flip = _mm256_set1_epi64x((long long)0x8000000000000000ull),
+                key = _mm256_xor_si256(_mm256_set1_epi64x((long long)k),flip);
+
+            for (uint32_t i=0;i<n;i+=4) {
+                __m256i
+                    v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + i)),flip);
+                uint32_t
+                    mask;
+
+                if (orEqual)
+                    mask = ~_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v,key))) & 0xf;
+                else
+                    mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(key,v)));
+                if (n - i < 4)
+                    mask &= (1u << (n - i)) - 1;
+                count += __builtin_popcount(mask);
+            }
+
+            return count;
+        }
+#elif defined(__SSE4_2__)
+        if constexpr (std::is_same<KeyType,uint64_t>::value) {
+            const __m128i
+                flip = _mm_set1_epi64x((long long)0x8000000000000000ull),
+                key = _mm_xor_si128(_mm_set1_epi64x((long long)k),flip);
+
+            for (uint32_t i=0;i<n;i+=2) {
+                __m128i
+                    v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(keys + i)),flip);
+                uint32_t
+                    mask;
+
+                if (orEqual)
+                    mask = ~_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v,key))) & 0x3;
+                else
+                    mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(key,v)));
+                if (n - i < 2)
+                    mask &= 1;
+                count += __builtin_popcount(mask);
+            }
+
+            return count;
+        }
+#endif
+
+        for (uint32_t i=0;i<n;i++)
+            count += orEqual ? !(k < keys[i]) : (keys[i] < k);
+
+        return count;
+    }
+
+    // the child of inner whose range holds k
+    static uint32_t prvChildIndex(Inner *inner,const KeyType &k) {
+
+        return prvCountBelow<true>(inner->keys,inner->n - 1,k);
+    }
+
+    // number of pairs in the leaves left of the one that would hold k; leaf is set to
+    // that leaf. the tree must not be empty
+    uint32_t prvCountBefore(const KeyType &k,Leaf *&leaf) {
+        Node
+            *node = root;
+        uint32_t
+            pos = 0;
+
+        while (!node->isLeaf) {
+            Inner
+                *inner = prvInner(node);
+            uint32_t
+                c = prvChildIndex(inner,k);
+
+            for (uint32_t j=0;j<c;j++)
+                pos += inner->counts[j];
+
+            node = inner->children[c];
+        }
+
+        leaf = prvLeaf(node);
+
+        return pos;
+    }
+
+    template <bool orEqual>
+    uint32_t prvCountUpTo(const KeyType &k) {
+        Leaf
+            *leaf;
+        uint32_t
+            pos;
+
+        if (root == nullptr)
+            return 0;
+
+        pos = prvCountBefore(k,leaf);
+
+        return pos + prvCountBelow<orEqual>(leaf->keys,leaf->n,k);
+    }
+
+    // split the full child i of p in two, adding the new right half as child i+1
+    void prvSplitChild(Inner *p,uint32_t i) {
+        Node
+            *child = p->children[i],
+            *sibling;
+        KeyType
+            separator;
+        uint32_t
+            half = child->n / 2,
+            rightCount = 0;
+
+        if (child->isLeaf) {
+            Leaf
+                *left = prvLeaf(child),
+                *right = prvNewLeaf();
+
+            right->n = left->n - half;
+            std::move(left->keys + half,left->keys + left->n,right->keys);
+            std::move(left->values + half,left->values + left->n,right->values);
+            left->n = half;
+
+            right->next = left->next;
+            left->next = right;
+
+            separator = right->keys[0];
+            rightCount = right->n;
+            sibling = right;
+        } else {
+            Inner
+                *left = prvInner(child),
+                *right = prvNewInner();
+
+            // children [half,n) move right; the key between the halves moves up
+            right->n = left->n - half;
+            std::move(left->keys + half,left->keys + left->n - 1,right->keys);
+            std::copy(left->children + half,left->children + left->n,right->children);
+            std::copy(left->counts + half,left->counts + left->n,right->counts);
+            separator = std::move(left->keys[half-1]);
+            left->n = half;
+
+            for (uint32_t j=0;j<right->n;j++)
+                rightCount += right->counts[j];
+            sibling = right;
+        }
+
+        std::move_backward(p->keys + i,p->keys + p->n - 1,p->keys + p->n);
+        std::copy_backward(p->children + i + 1,p->children + p->n,p->children + p->n + 1);
+        std::copy_backward(p->counts + i + 1,p->counts + p->n,p->counts + p->n + 1);
+
+        p->keys[i] = std::move(separator);
+        p->children[i+1] = sibling;
+        p->counts[i+1] = rightCount;
+        p->counts[i] -= rightCount;
+        p->n++;
+    }
+
+    // make sure child i of p holds more than the minimum, borrowing from a sibling
+    // that can spare one or else merging with a sibling. returns the child's index
+    // afterwards, which a merge with the left sibling moves down by one
+    uint32_t prvFillChild(Inner *p,uint32_t i) {
+
+        if (i > 0 && !prvIsMinimal(p->children[i-1])) {
+            prvBorrowFromLeft(p,i);
+            return i;
+        }
+
+        if (i + 1 < p->n && !prvIsMinimal(p->children[i+1])) {
+            prvBorrowFromRight(p,i);
+            return i;
+        }
+
+        if (i > 0) {
+            prvMerge(p,i - 1);
+            return i - 1;
+        }
+
+        prvMerge(p,i);
+
+        return i;
+    }
+
+    void prvBorrowFromLeft(Inner *p,uint32_t i) {
+        Node
+            *left = p->children[i-1],
+            *child = p->children[i];
+        uint32_t
+            moved;
+
+        if (child->isLeaf) {
+            Leaf
+                *l = prvLeaf(left),
+                *c = prvLeaf(child);
+
+            std::move_backward(c->keys,c->keys + c->n,c->keys + c->n + 1);
+            std::move_backward(c->values,c->values + c->n,c->values + c->n + 1);
+            c->keys[0] = std::move(l->keys[l->n-1]);
+            c->values[0] = std::move(l->values[l->n-1]);
+            l->n--;
+            c->n++;
+
+            p->keys[i-1] = c->keys[0];
+            moved = 1;
+        } else {
+            Inner
+                *l = prvInner(left),
+                *c = prvInner(child);
+
+            // l's last child comes across; the separators rotate through p
+            std::move_backward(c->keys,c->keys + c->n - 1,c->keys + c->n);
+            std::copy_backward(c->children,c->children + c->n,c->children + c->n + 1);
+            std::copy_backward(c->counts,c->counts + c->n,c->counts + c->n + 1);
+            c->keys[0] = std::move(p->keys[i-1]);
+            c->children[0] = l->children[l->n-1];
+            c->counts[0] = moved = l->counts[l->n-1];
+            p->keys[i-1] = std::move(l->keys[l->n-2]);
+            l->n--;
+            c->n++;
+        }
+
+        p->counts[i-1] -= moved;
+        p->counts[i] += moved;
+    }
+
+    void prvBorrowFromRight(Inner *p,uint32_t i) {
+        Node
+            *child = p->children[i],
+            *right = p->children[i+1];
+        uint32_t
+            moved;
+
+        if (child->isLeaf) {
+            Leaf
+                *c = prvLeaf(child),
+                *r = prvLeaf(right);
+
+            c->keys[c->n] = std::move(r->keys[0]);
+            c->values[c->n] = std::move(r->values[0]);
+            c->n++;
+            std::move(r->keys + 1,r->keys + r->n,r->keys);
+            std::move(r->values + 1,r->values + r->n,r->values);
+            r->n--;
+
+            p->keys[i] = r->keys[0];
+            moved = 1;
+        } else {
+            Inner
+                *c = prvInner(child),
+                *r = prvInner(right);
+
+            // r's first child comes across; the separators rotate through p
+            c->keys[c->n-1] = std::move(p->keys[i]);
+            c->children[c->n] = r->children[0];
+            c->counts[c->n] = moved = r->counts[0];
+            c->n++;
+            p->keys[i] = std::move(r->keys[0]);
+            std::move(r->keys + 1,r->keys + r->n - 1,r->keys);
+            std::copy(r->children + 1,r->children + r->n,r->children);
+            std::copy(r->counts + 1,r->counts + r->n,r->counts);
+            r->n--;
+        }
+
+        p->counts[i] += moved;
+        p->counts[i+1] -= moved;
+    }
+
+    // fold child i+1 of p into child i; both hold the minimum or less, so they fit
+    void prvMerge(Inner *p,uint32_t i) {
+        Node
+            *left = p->children[i],
+            *right = p->children[i+1];
+
+        if (left->isLeaf) {
+            Leaf
+                *l = prvLeaf(left),
+                *r = prvLeaf(right);
+
+            std::move(r->keys,r->keys + r->n,l->keys + l->n);
+            std::move(r->values,r->values + r->n,l->values + l->n);
+            l->n += r->n;
+            l->next = r->next;
+
+            delete r;
+        } else {
+            Inner
+                *l = prvInner(left),
+                *r = prvInner(right);
+
+            // the separator between them comes down between their keys
+            l->keys[l->n-1] = std::move(p->keys[i]);
+            std::move(r->keys,r->keys + r->n - 1,l->keys + l->n);
+            std::copy(r->children,r->children + r->n,l->children + l->n);
+            std::copy(r->counts,r->counts + r->n,l->counts + l->n);
+            l->n += r->n;
+
+            delete r;
+        }
+
+        p->counts[i] += p->counts[i+1];
+        std::move(p->keys + i + 1,p->keys + p->n - 1,p->keys + i);
+        std::copy(p->children + i + 2,p->children + p->n,p->children + i + 1);
+        std::copy(p->counts + i + 2,p->counts + p->n,p->counts + i + 1);
+        p->n--;
+    }
+
+    // drop roots with a single child, and an empty root leaf
+    void prvShrinkRoot() {
+
+        while (!root->isLeaf && root->n == 1) {
+            Inner
+                *old = prvInner(root);
+
+            root = old->children[0];
+            delete old;
+        }
+
+        if (root->isLeaf && root->n == 0) {
+            delete prvLeaf(root);
+            root = nullptr;
+        }
+    }
+
+    void prvClear(Node *node) {
+
+        if (node == nullptr)
+            return;
+
+        if (node->isLeaf) {
+            delete prvLeaf(node);
+            return;
+        }
+
+        for (uint32_t i=0;i<node->n;i++)
+            prvClear(prvInner(node)->children[i]);
+        delete prvInner(node);
+    }
+
+    // check the subtree at node, whose keys must lie in [lo,hi) where given; returns
+    // the number of pairs in it
+    uint32_t prvCheck(Node *node,uint32_t depth,uint32_t &leafDepth,const KeyType *lo,
+                      const KeyType *hi) {
+        uint32_t
+            nKeys = node->isLeaf ? node->n : node->n - 1,
+            total = 0;
+
+        if (node != root && node->n < BPT_MIN_SIZE)
+            throw std::logic_error("node below minimum occupancy");
+        if (node->n > BPT_NODE_SIZE || (!node->isLeaf && node->n < 2))
+            throw std::logic_error("bad node size");
+
+        for (uint32_t i=0;i<nKeys;i++) {
+            if (i > 0 && !(node->keys[i-1] < node->keys[i]))
+                throw std::logic_error("keys out of order within a node");
+            if ((lo != nullptr && node->keys[i] < *lo) || (hi != nullptr && !(node->keys[i] < *hi)))
+                throw std::logic_error("key outside its separators");
+        }
+
+        if (node->isLeaf) {
+            if (leafDepth == 0)
+                leafDepth = depth;
+            if (leafDepth != depth)
+                throw std::logic_error("leaves at different depths");
+            return node->n;
+        }
+
+        Inner
+            *inner = prvInner(node);
+
+        for (uint32_t i=0;i<inner->n;i++) {
+            uint32_t
+                count = prvCheck(inner->children[i],depth + 1,leafDepth,
+                                 (i == 0) ? lo : &inner->keys[i-1],
+                                 (i == inner->n - 1) ? hi : &inner->keys[i]);
+
+            if (count != inner->counts[i])
+                throw std::logic_error("wrong child count");
+            total += count;
+        }
+
+        return total;
+    }
+
+    Node
+        *root;
+
+    uint32_t
+        nPairs;
+};
+
+#endif //BPLUSTREE_H
@@ -0,0 +1,1062 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <sstream>
+#include "bstree.h"
+#include "redBlackTree.h"
+#include "concurrentTree.h"
+#include "bPlusTree.h"
+
+using namespace std;
+
+const uint32_t
+    DEFAULT_N_KEYS = 1000000,
+    REGULAR_THRESHOLD = 100000,
+    SORTED_BST_THRESHOLD = 20000,
+    READ_BENCH_MS = 200,
+    DEFAULT_LAYOUT_MAX_KEYS = DEFAULT_N_KEYS,   // -l100000000 for the full sweep
+    LAYOUT_LOOKUPS = 1000000;
+
+uint32_t
+    nKeys = DEFAULT_N_KEYS,
+    layoutMaxKeys = DEFAULT_LAYOUT_MAX_KEYS;
+
+chrono::steady_clock::time_point
+    startTime;
+
+// every heap allocation in the program is counted, so benchmarks can report them.
+// all the plain forms are replaced together, so every new is paired with its delete
+atomic<uint64_t>
+    nAllocations(0);
+
+void *countedAllocate(size_t size) {
+    void
+        *p;
+
+    nAllocations++;
+    if ((p = malloc(size ? size : 1)) == nullptr)
+        throw bad_alloc();
+
+    return p;
+}
+
+void *operator new(size_t size) { return countedAllocate(size); }
+void *operator new[](size_t size) { return countedAllocate(size); }
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p,size_t) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete[](void *p,size_t) noexcept { free(p); }
+
+void startTimer() {
+
+    startTime = chrono::steady_clock::now();
+}
+
+// print milliseconds since startTimer() along with the cost per key (or per unit);
+// returns the milliseconds
+double stopTimer(const char *label,uint32_t n,const char *unit="key") {
+    double
+        ms = chrono::duration<double,milli>(chrono::steady_clock::now() - startTime).count();
+
+    cout << setw(32) << label << ": " << fixed << setprecision(2) << setw(10) << ms << " ms  "
+         << setw(8) << (n ? 1e6 * ms / n : 0.0) << " ns/" << unit << endl;
+
+    return ms;
+}
+
+// time a SortedLinearList through n inserts, searches and removes; returns its height
+// when full
+template <typename List>
+int32_t benchList(List &list,const char *name,uint64_t *keys,uint32_t n) {
+    char
+        label[64];
+    int32_t
+        height;
+    uint64_t
+        sum = 0;
+
+    startTimer();
+    REPI(i,0,n)
+        list.insert(keys[i]);
+    snprintf(label,sizeof(label),"%s insert",name);
+    stopTimer(label,n);
+    height = list.height();
+
+    startTimer();
+    REPI(i,0,n)
+        sum += list.search(keys[i]);
+    snprintf(label,sizeof(label),"%s search",name);
+    stopTimer(label,n);
+
+    startTimer();
+    REPI(i,0,n)
+        list.remove(keys[i]);
+    snprintf(label,sizeof(label),"%s remove",name);
+    stopTimer(label,n);
+
+    if (sum == 0 && n > 1)
+        cout << "(zero rank sum)" << endl;
+
+    return height;
+}
+
+void benchInsertRemove(const char *title,uint64_t *keys,uint32_t n,uint32_t bstLimit) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    SortedLinearList<uint64_t>
+        bst;
+    SortedLinearList<uint64_t>
+        avl(AVL_BALANCED);
+    int32_t
+        rbHeight,
+        avlHeight,
+        bstHeight;
+    uint64_t
+        sum = 0;
+
+    cout << "\n" << title << " keys:" << endl;
+
+    startTimer();
+    REPI(i,0,n)
+        rb[keys[i]] = i;
+    stopTimer("RedBlackTree insert",n);
+    rbHeight = rb.height();
+
+    startTimer();
+    REPI(i,0,n)
+        rb[keys[i]] = i + 1;
+    stopTimer("RedBlackTree update",n);
+
+    startTimer();
+    REPI(i,0,n)
+        sum += rb.search(keys[i]);
+    stopTimer("RedBlackTree search",n);
+
+    startTimer();
+    REPI(i,0,n)
+        rb.remove(keys[i]);
+    stopTimer("RedBlackTree remove",n);
+
+    avlHeight = benchList(avl,"AVL SortedLinearList",keys,n);
+
+    // the plain BST can be quadratic, so keep it small
+    bstHeight = benchList(bst,"SortedLinearList",keys,(n > bstLimit) ? bstLimit : n);
+
+    cout << setw(32) << "heights" << ": RB " << rbHeight << ", AVL " << avlHeight << ", plain BST "
+         << bstHeight << ((n > bstLimit) ? " (fewer keys)" : "") << endl;
+
+    if (sum == 0 && n > 1)
+        cout << "(zero value sum)" << endl;
+}
+
+void benchBulkLoad(uint64_t *sortedKeys,uint32_t n) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    SortedLinearList<uint64_t>
+        bst;
+    auto
+        vals = new uint32_t[n];
+
+    REPI(i,0,n)
+        vals[i] = i;
+
+    cout << "\nLoading sorted keys:" << endl;
+
+    startTimer();
+    REPI(i,0,n)
+        rb[sortedKeys[i]] = vals[i];
+    stopTimer("RedBlackTree operator[]",n);
+
+    startTimer();
+    rb.buildFromSorted(sortedKeys,vals,n);
+    stopTimer("RedBlackTree buildFromSorted",n);
+
+    startTimer();
+    bst.buildFromSorted(sortedKeys,n);
+    stopTimer("SortedLinearList buildFromSorted",n);
+
+    delete[] vals;
+}
+
+// build an n-key tree from unsorted keys: std::sort then buildFromSorted(), against
+// buildFromUnsorted() on one thread and on every core, with its radix sort timed alone
+void benchParallelBuild(uint64_t *keys,uint32_t n) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    vector<uint64_t>
+        sorted(n);
+    vector<uint32_t>
+        vals(n),
+        sortedVals(n),
+        threadCounts = {1};
+    char
+        label[64];
+
+    if (thread::hardware_concurrency() > 1)
+        threadCounts.push_back(thread::hardware_concurrency());
+
+    REPI(i,0,n)
+        vals[i] = i;
+
+    cout << "\nBuilding from " << n << " unsorted keys:" << endl;
+
+    startTimer();
+    copy(keys,keys + n,sorted.begin());
+    sort(sorted.begin(),sorted.end());
+    rb.buildFromSorted(sorted.data(),vals.data(),n);
+    stopTimer("std::sort + buildFromSorted",n);
+
+    for (uint32_t nThreads : threadCounts) {
+        snprintf(label,sizeof(label),"parallelSortPairs, %u threads",nThreads);
+        startTimer();
+        parallelSortPairs(keys,vals.data(),n,sorted.data(),sortedVals.data(),nThreads);
+        stopTimer(label,n);
+
+        snprintf(label,sizeof(label),"buildFromUnsorted, %u threads",nThreads);
+        startTimer();
+        rb.buildFromUnsorted(keys,vals.data(),n,nThreads);
+        stopTimer(label,n);
+    }
+
+    if (rb.size() != n)
+        cout << "sizes differ!" << endl;
+}
+
+uint64_t
+    scanLo,
+    scanHi,
+    scanSum;
+
+void scanVisitor(const uint64_t &k,uint32_t &v) {
+
+    if (scanLo <= k && k <= scanHi)
+        scanSum += v;
+}
+
+void sumVisitor(const uint64_t &,uint32_t &v) {
+
+    scanSum += v;
+}
+
+// visit every pair of an n-key tree, through a function pointer and through a lambda
+void benchFullScan(uint64_t *sortedKeys,uint32_t n) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    auto
+        vals = new uint32_t[n];
+    uint64_t
+        sum = 0;
+
+    REPI(i,0,n)
+        vals[i] = i;
+
+    rb.buildFromSorted(sortedKeys,vals,n);
+
+    cout << "\nFull scan:" << endl;
+
+    scanSum = 0;
+    startTimer();
+    rb.map(sumVisitor);
+    stopTimer("map(function pointer)",n);
+
+    startTimer();
+    rb.map([&sum](const uint64_t &,uint32_t &v) { sum += v; });
+    stopTimer("map(lambda)",n);
+
+    if (sum != scanSum)
+        cout << "sums differ!" << endl;
+
+    delete[] vals;
+}
+
+// sum the values of about width consecutive keys, nQueries times
+void benchRangeScan(uint64_t *sortedKeys,uint32_t n,uint32_t width,uint32_t nQueries,mt19937 &mt) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    uniform_int_distribution<uint32_t>
+        dis(0,n - width);
+    auto
+        vals = new uint32_t[n];
+    auto
+        starts = new uint32_t[nQueries];
+    uint64_t
+        sum = 0;
+
+    REPI(i,0,n)
+        vals[i] = i;
+    REPI(i,0,nQueries)
+        starts[i] = dis(mt);
+
+    rb.buildFromSorted(sortedKeys,vals,n);
+
+    cout << "\nRange scans of " << width << " keys:" << endl;
+
+    startTimer();
+    REPI(i,0,nQueries)
+        for (auto &v : rb.range(sortedKeys[starts[i]],sortedKeys[starts[i] + width - 1]))
+            sum += v;
+    stopTimer("range()",nQueries,"query");
+
+    // a full map() per query is slow; a handful of queries is enough
+    nQueries = (nQueries < 10) ? nQueries : 10;
+    scanSum = 0;
+    startTimer();
+    REPI(i,0,nQueries) {
+        scanLo = sortedKeys[starts[i]];
+        scanHi = sortedKeys[starts[i] + width - 1];
+        rb.map(scanVisitor);
+    }
+    stopTimer("map() and filter",nQueries,"query");
+
+    if (sum == 0 && scanSum == 0)
+        cout << "(empty sums)" << endl;
+
+    delete[] starts;
+    delete[] vals;
+}
+
+// load a tree of n keys, then add a batch of batchSize fresh random keys to it
+void benchBatch(uint64_t *sortedKeys,uint32_t n,uint32_t batchSize,mt19937 &mt) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    uniform_int_distribution<uint64_t>
+        dis;
+    auto
+        vals = new uint32_t[n];
+    auto
+        batchKeys = new uint64_t[batchSize];
+    auto
+        batchVals = new uint32_t[batchSize];
+    char
+        label[64];
+
+    REPI(i,0,n)
+        vals[i] = i;
+    REPI(i,0,batchSize) {
+        batchKeys[i] = dis(mt);
+        batchVals[i] = i;
+    }
+
+    rb.buildFromSorted(sortedKeys,vals,n);
+    startTimer();
+    REPI(i,0,batchSize)
+        rb[batchKeys[i]] = batchVals[i];
+    snprintf(label,sizeof(label),"%u into %u operator[]",batchSize,n);
+    stopTimer(label,batchSize);
+
+    rb.buildFromSorted(sortedKeys,vals,n);
+    startTimer();
+    rb.insertBatch(batchKeys,batchVals,batchSize);
+    snprintf(label,sizeof(label),"%u into %u insertBatch",batchSize,n);
+    stopTimer(label,batchSize);
+
+    delete[] batchVals;
+    delete[] batchKeys;
+    delete[] vals;
+}
+
+// nThreads readers search random keys for READ_BENCH_MS while one writer keeps updating
+void benchConcurrentReads(uint64_t *randomKeys,uint32_t n,uint32_t nThreads) {
+    ConcurrentRedBlackTree<uint64_t,uint32_t>
+        ct;
+    atomic<bool>
+        done(false);
+    atomic<uint64_t>
+        nReads(0),
+        nWrites(0);
+    vector<thread>
+        readers;
+    char
+        label[64];
+
+    REPI(i,0,n)
+        ct.insertOrAssign(randomKeys[i],i);
+
+    startTimer();
+    REPI(t,0,nThreads)
+        readers.emplace_back([&,t]() {
+            uint64_t
+                count = 0;
+            uint32_t
+                v,
+                j = t * 7919;
+
+            while (!done.load(memory_order_relaxed)) {
+                REPI(rep,0,256) {
+                    j = (j + 40503) % n;
+                    if (ct.search(randomKeys[j],v))
+                        count++;
+                }
+            }
+            nReads += count;
+        });
+
+    // the writer reassigns values, pausing now and then so it does not starve the readers
+    for (uint32_t j=0;chrono::steady_clock::now() - startTime < chrono::milliseconds(READ_BENCH_MS);) {
+        REPI(rep,0,64) {
+            ct.insertOrAssign(randomKeys[j],j + 1);
+            j = (j + 1) % n;
+        }
+        nWrites += 64;
+        this_thread::sleep_for(chrono::microseconds(50));
+    }
+    done = true;
+    for (auto &t : readers)
+        t.join();
+
+    snprintf(label,sizeof(label),"%u reader%s",nThreads,nThreads == 1 ? "" : "s");
+    stopTimer(label,nReads.load(),"read");
+    cout << setw(32) << "" << "  " << setw(10) << nReads.load() << " reads, " << nWrites.load()
+         << " writes" << endl;
+}
+
+// bump the value of every key nPasses times, looking each key up again versus
+// going through a handle kept from the insert
+void benchHandles(uint64_t *keys,uint32_t n,uint32_t nPasses) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    auto
+        handles = new uint32_t[n];
+
+    REPI(i,0,n)
+        rb.valueAt(handles[i] = rb.insertHandle(keys[i])) = 0;
+
+    cout << "\nRepeat updates, " << nPasses << " passes:" << endl;
+
+    startTimer();
+    REPI(pass,0,nPasses)
+        REPI(i,0,n)
+            rb[keys[i]]++;
+    stopTimer("operator[]",nPasses * n,"update");
+
+    startTimer();
+    REPI(pass,0,nPasses)
+        REPI(i,0,n)
+            rb.valueAt(handles[i])++;
+    stopTimer("valueAt(handle)",nPasses * n,"update");
+
+    if (rb.valueAt(handles[0]) != 2 * nPasses)
+        cout << "values differ!" << endl;
+
+    delete[] handles;
+}
+
+// random successful lookups, one at a time and in batches of interleaved descents
+template <typename Layout>
+void benchSearchBatch(const char *name,uint64_t *keys,uint32_t n,uint64_t *probeKeys) {
+    RedBlackTree<uint64_t,uint32_t,Layout>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    auto
+        handles = new uint32_t[LAYOUT_LOOKUPS];
+    uint64_t
+        sum = 0,
+        batchSum = 0;
+    char
+        label[64];
+
+    REPI(i,0,n)
+        rb[keys[i]] = i;
+
+    snprintf(label,sizeof(label),"%s findHandle loop",name);
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        sum += rb.findHandle(probeKeys[i]);
+    stopTimer(label,LAYOUT_LOOKUPS,"lookup");
+
+    snprintf(label,sizeof(label),"%s searchBatch<8>",name);
+    startTimer();
+    rb.template searchBatch<8>(probeKeys,handles,LAYOUT_LOOKUPS);
+    stopTimer(label,LAYOUT_LOOKUPS,"lookup");
+
+    snprintf(label,sizeof(label),"%s searchBatch<16>",name);
+    startTimer();
+    rb.template searchBatch<16>(probeKeys,handles,LAYOUT_LOOKUPS);
+    stopTimer(label,LAYOUT_LOOKUPS,"lookup");
+
+    snprintf(label,sizeof(label),"%s searchBatch<32>",name);
+    startTimer();
+    rb.template searchBatch<32>(probeKeys,handles,LAYOUT_LOOKUPS);
+    stopTimer(label,LAYOUT_LOOKUPS,"lookup");
+
+    REPI(i,0,LAYOUT_LOOKUPS)
+        batchSum += handles[i];
+    if (sum != batchSum)
+        cout << "handles differ!" << endl;
+
+    delete[] handles;
+}
+
+void benchSearchBatches(uint64_t *keys,uint32_t n,mt19937 &mt) {
+    uniform_int_distribution<uint32_t>
+        dis(0,n - 1);
+    auto
+        probeKeys = new uint64_t[LAYOUT_LOOKUPS];
+
+    REPI(i,0,LAYOUT_LOOKUPS)
+        probeKeys[i] = keys[dis(mt)];
+
+    cout << "\nBatched lookups, " << n << " keys:" << endl;
+    benchSearchBatch<SoALayout>("SoA",keys,n,probeKeys);
+    benchSearchBatch<HotColdLayout>("hot/cold",keys,n,probeKeys);
+
+    delete[] probeKeys;
+}
+
+// random successful lookups in an n-key tree stored with the given node layout
+template <typename Layout>
+void benchLayout(const char *name,uint64_t *keys,uint32_t *vals,uint32_t n,uint32_t *probes) {
+    RedBlackTree<uint64_t,uint32_t,Layout>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    uint64_t
+        sum = 0;
+    char
+        label[64];
+
+    rb.buildFromSorted(keys,vals,n);
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        sum += rb.search(keys[probes[i]]);
+    snprintf(label,sizeof(label),"%u keys, %s",n,name);
+    stopTimer(label,LAYOUT_LOOKUPS,"lookup");
+
+    if (sum == 0 && n > 1)
+        cout << "(zero value sum)" << endl;
+}
+
+void benchLayouts(uint32_t maxKeys,mt19937 &mt) {
+    auto
+        keys = new uint64_t[maxKeys];
+    auto
+        vals = new uint32_t[maxKeys];
+    auto
+        probes = new uint32_t[LAYOUT_LOOKUPS];
+
+    // spread-out keys, so they are not just the indices
+    REPI(i,0,maxKeys) {
+        keys[i] = 0x9e3779b9ull * i;
+        vals[i] = i;
+    }
+
+    cout << "\nLookups by node layout:" << endl;
+    for (uint32_t n = 1000; n <= maxKeys; n *= 10) {
+        uniform_int_distribution<uint32_t>
+            dis(0,n - 1);
+
+        REPI(i,0,LAYOUT_LOOKUPS)
+            probes[i] = dis(mt);
+
+        benchLayout<SoALayout>("SoA",keys,vals,n,probes);
+        benchLayout<AoSLayout>("AoS",keys,vals,n,probes);
+        benchLayout<HotColdLayout>("hot/cold",keys,vals,n,probes);
+
+        if (n > NULL_INDEX / 10)
+            break;
+    }
+
+    delete[] probes;
+    delete[] vals;
+    delete[] keys;
+}
+
+// random search, rank and select on the live tree and on its frozen snapshot
+void benchFrozen(uint32_t n,mt19937 &mt) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    uniform_int_distribution<uint32_t>
+        dis(0,n - 1);
+    auto
+        keys = new uint64_t[n];
+    auto
+        vals = new uint32_t[n];
+    auto
+        probes = new uint32_t[LAYOUT_LOOKUPS];
+    uint64_t
+        sum = 0,
+        frozenSum = 0;
+
+    REPI(i,0,n) {
+        keys[i] = 0x9e3779b9ull * i;
+        vals[i] = i;
+    }
+    REPI(i,0,LAYOUT_LOOKUPS)
+        probes[i] = dis(mt);
+
+    rb.buildFromSorted(keys,vals,n);
+
+    cout << "\nLive vs frozen, " << n << " keys:" << endl;
+
+    startTimer();
+    auto
+        frozen = rb.freeze();
+    stopTimer("freeze()",n);
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        sum += rb.search(keys[probes[i]]);
+    stopTimer("RedBlackTree search",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        frozenSum += frozen.search(keys[probes[i]]);
+    stopTimer("FrozenTree search",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        sum += rb.rank(keys[probes[i]]);
+    stopTimer("RedBlackTree rank",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        frozenSum += frozen.rank(keys[probes[i]]);
+    stopTimer("FrozenTree rank",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        sum += rb.select(probes[i]);
+    stopTimer("RedBlackTree select",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        frozenSum += frozen.select(probes[i]);
+    stopTimer("FrozenTree select",LAYOUT_LOOKUPS,"lookup");
+
+    if (sum != frozenSum)
+        cout << "sums differ!" << endl;
+
+    delete[] probes;
+    delete[] vals;
+    delete[] keys;
+}
+
+// the red-black and B+-tree engines on the same random keys: insert, search, rank,
+// select, an in-order walk, then remove
+void benchBPlusTree(uint64_t *keys,uint32_t n,mt19937 &mt) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    BPlusTree<uint64_t,uint32_t>
+        bp;
+    uniform_int_distribution<uint32_t>
+        dis(0,n - 1);
+    auto
+        probes = new uint32_t[LAYOUT_LOOKUPS];
+    uint64_t
+        rbSum = 0,
+        bpSum = 0;
+
+    REPI(i,0,LAYOUT_LOOKUPS)
+        probes[i] = dis(mt);
+
+#if defined(__AVX2__)
+    cout << "\nRedBlackTree vs BPlusTree (AVX2 node search), " << n << " keys:" << endl;
+#elif defined(__SSE4_2__)
+    cout << "\nRedBlackTree vs BPlusTree (SSE4.2 node search), " << n << " keys:" << endl;
+#else
+    cout << "\nRedBlackTree vs BPlusTree (scalar node search), " << n << " keys:" << endl;
+#endif
+
+    startTimer();
+    REPI(i,0,n)
+        rb[keys[i]] = i;
+    stopTimer("RedBlackTree insert",n);
+
+    startTimer();
+    REPI(i,0,n)
+        bp[keys[i]] = i;
+    stopTimer("BPlusTree insert",n);
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        rbSum += rb.search(keys[probes[i]]);
+    stopTimer("RedBlackTree search",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        bpSum += bp.search(keys[probes[i]]);
+    stopTimer("BPlusTree search",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        rbSum += rb.rank(keys[probes[i]]);
+    stopTimer("RedBlackTree rank",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        bpSum += bp.rank(keys[probes[i]]);
+    stopTimer("BPlusTree rank",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        rbSum += rb.select(probes[i]);
+    stopTimer("RedBlackTree select",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    REPI(i,0,LAYOUT_LOOKUPS)
+        bpSum += bp.select(probes[i]);
+    stopTimer("BPlusTree select",LAYOUT_LOOKUPS,"lookup");
+
+    startTimer();
+    rb.map([&rbSum](const uint64_t &,uint32_t &v) { rbSum += v; });
+    stopTimer("RedBlackTree map",n);
+
+    startTimer();
+    bp.map([&bpSum](const uint64_t &,uint32_t &v) { bpSum += v; });
+    stopTimer("BPlusTree map",n);
+
+    startTimer();
+    REPI(i,0,n)
+        rb.remove(keys[i]);
+    stopTimer("RedBlackTree remove",n);
+
+    startTimer();
+    REPI(i,0,n)
+        bp.remove(keys[i]);
+    stopTimer("BPlusTree remove",n);
+
+    if (rbSum != bpSum)
+        cout << "sums differ!" << endl;
+
+    delete[] probes;
+}
+
+// what a restart costs: rebuilding an n-key tree by insertion against reopening it
+// from a pool file. the file is still in the page cache, as after a process restart
+void benchPoolFile(uint64_t *keys,uint32_t n,mt19937 &mt) {
+    const char
+        *path = "bench.pool";
+    uniform_int_distribution<uint32_t>
+        dis(0,n - 1);
+    auto
+        probes = new uint32_t[LAYOUT_LOOKUPS];
+    uint64_t
+        sum = 0,
+        fileSum = 0;
+
+    REPI(i,0,LAYOUT_LOOKUPS)
+        probes[i] = dis(mt);
+
+    remove(path);
+
+    cout << "\nRestart, " << n << " keys:" << endl;
+
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+
+        startTimer();
+        REPI(i,0,n)
+            rb[keys[i]] = i;
+        stopTimer("rebuild by operator[]",n);
+
+        REPI(i,0,LAYOUT_LOOKUPS)
+            sum += rb.search(keys[probes[i]]);
+    }
+
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            rb(path);
+
+        startTimer();
+        REPI(i,0,n)
+            rb[keys[i]] = i;
+        stopTimer("fill a pool file",n);
+
+        startTimer();
+        rb.checkpoint();
+        stopTimer("checkpoint()",n);
+    }
+
+    startTimer();
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            rb(path);
+
+        stopTimer("reopen the pool file",n);
+
+        startTimer();
+        REPI(i,0,LAYOUT_LOOKUPS)
+            fileSum += rb.search(keys[probes[i]]);
+        stopTimer("first searches after reopen",LAYOUT_LOOKUPS,"lookup");
+    }
+
+    if (sum != fileSum)
+        cout << "sums differ!" << endl;
+
+    remove(path);
+    delete[] probes;
+}
+
+// save an n-key tree to memory and load it back, raw and delta encoded, against
+// rebuilding it by insertion. dense keys are where delta encoding pays
+void benchSnapshot(const char *title,uint64_t *keys,uint32_t n) {
+    RedBlackTree<uint64_t,uint32_t>
+        rb(DEFAULT_INIT_CAPACITY,PRIVATE_POOL),
+        copy(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+    char
+        label[64];
+
+    cout << "\nSnapshots, " << n << " " << title << " keys:" << endl;
+
+    startTimer();
+    REPI(i,0,n)
+        rb[keys[i]] = i;
+    stopTimer("rebuild by operator[]",n);
+
+    for (bool delta : {false,true}) {
+        stringstream
+            ss;
+        double
+            ms;
+
+        startTimer();
+        rb.saveTo(ss,delta);
+        ms = stopTimer(delta ? "saveTo() delta" : "saveTo() raw",n);
+
+        uint64_t
+            bytes = ss.tellp();
+
+        snprintf(label,sizeof(label),"%.2f bytes/key, %.2f GB/s",(double)bytes / n,bytes / ms / 1e6);
+        cout << setw(32) << "" << "  " << label << endl;
+
+        startTimer();
+        copy.loadFrom(ss);
+        ms = stopTimer(delta ? "loadFrom() delta" : "loadFrom() raw",n);
+
+        snprintf(label,sizeof(label),"%.2f GB/s",bytes / ms / 1e6);
+        cout << setw(32) << "" << "  " << label << endl;
+
+        if (copy.size() != rb.size())
+            cout << "sizes differ!" << endl;
+    }
+}
+
+// split an n-key tree at a random key and join it back, against moving the keys above
+// that key to another tree one at a time
+void benchSplitJoin(uint64_t *keys,uint32_t n,mt19937 &mt) {
+    NodePool<uint64_t,uint32_t>
+        arena;
+    RedBlackTree<uint64_t,uint32_t>
+        rb(arena),less(arena),ge(arena);
+    uniform_int_distribution<uint32_t>
+        pick(0,n - 1);
+    const uint32_t
+        nRounds = 10000,
+        nSlowRounds = 3;
+    uint64_t
+        moved = 0;
+
+    cout << "\nSplit and join, " << n << " keys:" << endl;
+
+    REPI(i,0,n)
+        rb[keys[i]] = i;
+
+    startTimer();
+    REPI(round,0,nRounds) {
+        rb.split(keys[pick(mt)],less,ge);
+        less.join(ge);
+        rb.join(less);
+    }
+    stopTimer("split() + join()",nRounds,"round");
+
+    // the same migration, one key at a time, over a handful of rounds
+    startTimer();
+    REPI(round,0,nSlowRounds) {
+        uint64_t
+            k = keys[pick(mt)];
+        vector<pair<uint64_t,uint32_t>>
+            above;
+
+        rb.map([&](const uint64_t &key,uint32_t &v) {
+            if (!(key < k))
+                above.push_back({key,v});
+        });
+        for (auto &kv : above) {
+            rb.remove(kv.first);
+            ge[kv.first] = kv.second;
+        }
+        for (auto &kv : above) {
+            ge.remove(kv.first);
+            rb[kv.first] = kv.second;
+        }
+        moved += above.size();
+    }
+    stopTimer("remove and reinsert",nSlowRounds,"round");
+    cout << setw(32) << "" << "  " << moved / nSlowRounds << " keys moved per round" << endl;
+
+    if (rb.size() != n)
+        cout << "sizes differ!" << endl;
+}
+
+// merge two n-key trees sharing half their keys with unite(), on one thread and on
+// every core, against inserting the keys of one into the other through operator[]
+void benchSetOps(uint64_t *keys,uint32_t n,mt19937 &mt) {
+    NodePool<uint64_t,uint32_t>
+        arena;
+    RedBlackTree<uint64_t,uint32_t>
+        a(arena),b(arena);
+    uint64_t
+        *other = new uint64_t[n];
+    vector<uint32_t>
+        threadCounts = {1};
+    char
+        label[64];
+
+    if (thread::hardware_concurrency() > 1)
+        threadCounts.push_back(thread::hardware_concurrency());
+
+    cout << "\nSet operations, two trees of " << n << " keys:" << endl;
+
+    REPI(i,0,n)
+        other[i] = (i % 2 == 0) ? keys[i] : (((uint64_t)mt()) << 32) | (n + i);
+
+    auto refill = [&]() {
+        a.clear();
+        b.clear();
+        REPI(i,0,n) {
+            a[keys[i]] = i;
+            b[other[i]] = n + i;
+        }
+    };
+
+    refill();
+    startTimer();
+    REPI(i,0,n)
+        a[other[i]] = n + i;
+    stopTimer("merge by operator[]",n);
+
+    for (uint32_t nThreads : threadCounts) {
+        refill();
+        snprintf(label,sizeof(label),"unite(), %u threads",nThreads);
+        startTimer();
+        a.unite(b,nThreads);
+        stopTimer(label,n);
+
+        refill();
+        snprintf(label,sizeof(label),"intersect(), %u threads",nThreads);
+        startTimer();
+        a.intersect(b,nThreads);
+        stopTimer(label,n);
+
+        refill();
+        snprintf(label,sizeof(label),"subtract(), %u threads",nThreads);
+        startTimer();
+        a.subtract(b,nThreads);
+        stopTimer(label,n);
+    }
+
+    delete[] other;
+}
+
+// churn a BST: insert n keys, remove and re-add half of them, clear; three times over
+template <typename List>
+void churnList(List &list,uint64_t *keys,uint32_t n,const char *label) {
+    uint64_t
+        before = nAllocations;
+
+    startTimer();
+    REPI(round,0,3) {
+        REPI(i,0,n)
+            list.insert(keys[i]);
+        REPI(i,0,n / 2)
+            list.remove(keys[2*i]);
+        REPI(i,0,n / 2)
+            list.insert(keys[2*i]);
+        list.clear();
+    }
+    stopTimer(label,3 * 2 * n,"op");
+    cout << setw(32) << "" << "  " << setw(10) << nAllocations - before << " allocations" << endl;
+}
+
+void benchNodeAllocators(uint64_t *keys,uint32_t n) {
+    SortedLinearList<uint64_t>
+        heapList;
+    SortedLinearList<uint64_t,NodeArena<uint64_t>>
+        arenaList;
+
+    cout << "\nSortedLinearList node churn:" << endl;
+    churnList(heapList,keys,n,"HeapNodeAllocator");
+    churnList(arenaList,keys,n,"NodeArena");
+}
+
+int main(int argc,char *argv[]) {
+    uint64_t
+        *randomKeys,
+        *sortedKeys;
+    mt19937
+        mt(5870);
+    uniform_int_distribution<>
+        dis(0,0x3fffffff);
+
+    REPI(i,1,(uint32_t)argc)
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'k')
+                nKeys = strtol(argv[i]+2, nullptr,10);
+            if (argv[i][1] == 'l')
+                layoutMaxKeys = strtol(argv[i]+2, nullptr,10);
+        }
+
+    randomKeys = new uint64_t[nKeys];
+    sortedKeys = new uint64_t[nKeys];
+
+    REPI(j,0,nKeys) {
+        randomKeys[j] = (((uint64_t)dis(mt)) << 32) | j;
+        sortedKeys[j] = j;
+    }
+
+    cout << "Benchmarking with " << nKeys << " keys" << endl;
+
+    benchInsertRemove("Random",randomKeys,nKeys,REGULAR_THRESHOLD);
+    benchInsertRemove("Sorted",sortedKeys,nKeys,SORTED_BST_THRESHOLD);
+
+    benchHandles(randomKeys,nKeys,10);
+
+    benchLayouts(layoutMaxKeys,mt);
+
+    benchSearchBatches(randomKeys,nKeys,mt);
+
+    benchFrozen(nKeys,mt);
+
+    benchBPlusTree(randomKeys,nKeys,mt);
+
+    benchPoolFile(randomKeys,nKeys,mt);
+
+    benchSnapshot("random",randomKeys,nKeys);
+    benchSnapshot("sorted",sortedKeys,nKeys);
+
+    benchSplitJoin(randomKeys,nKeys,mt);
+
+    benchSetOps(randomKeys,nKeys,mt);
+
+    benchBulkLoad(sortedKeys,nKeys);
+    benchParallelBuild(randomKeys,nKeys);
+
+    benchFullScan(sortedKeys,nKeys);
+
+    if (nKeys >= 300)
+        benchRangeScan(sortedKeys,nKeys,300,10000,mt);
+
+    cout << "\nBatch insertion:" << endl;
+    for (uint32_t divisor : {1000,100,32,16,12,8,4,1})
+        benchBatch(sortedKeys,nKeys,nKeys / divisor,mt);
+    benchBatch(sortedKeys,nKeys / 4,nKeys,mt);
+
+    benchNodeAllocators(randomKeys,nKeys < REGULAR_THRESHOLD ? nKeys : REGULAR_THRESHOLD);
+
+    cout << "\nConcurrent reads, one writer (" << thread::hardware_concurrency() << " hardware threads):"
+         << endl;
+    for (uint32_t nThreads : {1,2,4,8,16,32,64})
+        benchConcurrentReads(randomKeys,nKeys,nThreads);
+
+    delete[] sortedKeys;
+    delete[] randomKeys;
+
+    return 0;
+}
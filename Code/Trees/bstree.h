@@ -14,12 +14,61 @@
 //      4 apr 2024
 //      - combined the two header files into one. Much cleaner.
 //
+//      16 oct 2026
+//      - insert, remove and clear are now iterative; sorted input no longer overflows
+//        the stack
+//      - added buildFromSorted()
+//      - traverse() takes any callable and no longer recurses; added traverseWhile()
+//      - nodes come from a pluggable allocator; added NodeArena, which recycles
+//        removed nodes and lets clear() give every node back at once
+//      - added an AVL_BALANCED mode, which keeps the tree height O(log n) whatever
+//        the insertion order; added isValidTree()
+//      - added insert(TreeType &&) and emplace()
+//      - error messages no longer need std::to_string(TreeType), so any ordered
+//        type can be stored
+//      - removing a node with two children splices its neighbor into its place
+//        instead of swapping data, so surviving data never moves
+//      - added freeze()
+//      - added saveTo() and loadFrom(); prvBuild() now fills nodes in sorted
+//        order, so a load can build the tree as the stream arrives
+//
 
 // new way to guarantee file is only included once, similar to php
 #pragma once
 
 #include <stdexcept>
 #include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <type_traits>
+#include "frozenTree.h"
+#include "snapshot.h"
+
+static const uint32_t
+    NODE_SLAB_SIZE = 256,           // nodes in a NodeArena's first slab
+    NODE_SLAB_MAX = 65536;          // slabs double in size up to this many nodes
+
+// AVL_BALANCED rotates after each insert and remove so that sibling subtree
+// heights never differ by more than one; UNBALANCED is a plain BST
+enum BalanceMode {
+    UNBALANCED,
+    AVL_BALANCED
+};
+
+// how a key appears in an error message: numbers and strings as themselves, anything
+// else just as "key"
+template <typename TreeType>
+std::string keyText(const TreeType &key) {
+
+    if constexpr (std::is_arithmetic<TreeType>::value)
+        return std::to_string(key);
+    else if constexpr (std::is_convertible<const TreeType &,std::string>::value)
+        return key;
+    else
+        return "key";
+}
 
 template <typename TreeType>
 struct TreeNode {
@@ -32,15 +81,123 @@ struct TreeNode {
         *left,*right;
 };
 
+//-----------------------------------------------------------------------------
+//  node allocators
+//
+//  a SortedLinearList gets its nodes from an allocator with three methods:
+//      TreeNode<TreeType> *allocate()      - a node, contents unspecified
+//      void release(TreeNode<TreeType> *)  - take back one node
+//      bool releaseAll()                   - take back every node at once, if it
+//                                            can; false means the list must
+//                                            release its nodes one by one
+//
+
+// the default: every node comes from new and goes back through delete
 template <typename TreeType>
+struct HeapNodeAllocator {
+    TreeNode<TreeType> *allocate() { return new TreeNode<TreeType>; }
+    void release(TreeNode<TreeType> *node) { delete node; }
+    bool releaseAll() { return false; }
+};
+
+// nodes are carved out of slabs; released nodes are kept on a free list
+// (threaded through left) and handed out again first. releaseAll() just forgets
+// every node and starts again at the first slab, so a clear() costs O(1) and
+// the slabs are reused rather than returned to the heap
+template <typename TreeType>
+class NodeArena {
+public:
+    NodeArena() {
+
+        freeList = nextUnused = slabEnd = nullptr;
+        nextSlab = 0;
+    }
+
+    ~NodeArena() {
+
+        for (auto slab : slabs)
+            delete[] slab;
+    }
+
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    TreeNode<TreeType> *allocate() {
+        TreeNode<TreeType>
+            *node;
+
+        // recycle a released node if there is one
+        if (freeList != nullptr) {
+            node = freeList;
+            freeList = node->left;
+            return node;
+        }
+
+        // otherwise take the next unused node, moving to a new slab if needed
+        if (nextUnused == slabEnd)
+            prvNextSlab();
+
+        return nextUnused++;
+    }
+
+    void release(TreeNode<TreeType> *node) {
+
+        node->left = freeList;
+        freeList = node;
+    }
+
+    bool releaseAll() {
+
+        freeList = nextUnused = slabEnd = nullptr;
+        nextSlab = 0;
+
+        return true;
+    }
+
+private:
+    void prvNextSlab() {
+        uint32_t
+            size;
+
+        // after a releaseAll(), reuse the slabs we already have
+        if (nextSlab == slabs.size()) {
+            size = slabs.empty() ? NODE_SLAB_SIZE : std::min(2 * slabSizes.back(),NODE_SLAB_MAX);
+            slabs.push_back(new TreeNode<TreeType>[size]);
+            slabSizes.push_back(size);
+        }
+
+        nextUnused = slabs[nextSlab];
+        slabEnd = nextUnused + slabSizes[nextSlab];
+        nextSlab++;
+    }
+
+    std::vector<TreeNode<TreeType> *>
+        slabs;              // every slab, in the order they were obtained
+    std::vector<uint32_t>
+        slabSizes;          // number of nodes in each slab
+    TreeNode<TreeType>
+        *freeList,          // released nodes, linked through left
+        *nextUnused,        // next never-used node in the current slab
+        *slabEnd;           // one past the end of the current slab
+    size_t
+        nextSlab;           // slab to move to when the current one runs out
+};
+
+template <typename TreeType,typename NodeAllocator = HeapNodeAllocator<TreeType>>
 class SortedLinearList {
 public:
-    SortedLinearList() { root = nullptr; }
-    ~SortedLinearList() { prvClear(root); }
+    explicit SortedLinearList(BalanceMode _mode=UNBALANCED) {
+
+        root = nullptr;
+        mode = _mode;
+    }
+    ~SortedLinearList() { clear(); }
 
     void clear() {
 
-        prvClear(root);
+        // let the allocator take everything back at once if it can
+        if (!nodes.releaseAll())
+            prvClear(root);
         root = nullptr;
     }
 
@@ -126,7 +283,7 @@ public:
             }
 
         // if we fall out of the loop, the key wasn't in the tree. throw an error.
-        throw std::domain_error("Key ["+std::to_string(key)+"] not found");
+        throw std::domain_error("Key ["+keyText(key)+"] not found");
     }
 
     //-----------------------------------------------------------------------------
@@ -183,31 +340,228 @@ public:
         }
     }
 
-    void traverse(void (*fp)(TreeType &)) { prvTraverse(root,fp); }
+    //-----------------------------------------------------------------------------
+    //  void SortedLinearList<TreeType>::traverse(Visitor &&visit)
+    //      call visit with each value in sorted order
+    //
+    //  parameter
+    //      visit - function pointer, lambda or other callable taking TreeType &
+    //
+
+    template <typename Visitor>
+    void traverse(Visitor &&visit) {
+
+        traverseWhile([&visit](TreeType &datum) { visit(datum); return true; });
+    }
+
+    //-----------------------------------------------------------------------------
+    //  bool SortedLinearList<TreeType>::traverseWhile(Visitor &&visit)
+    //      call visit with each value in sorted order until it returns false
+    //
+    //  parameter
+    //      visit - callable taking TreeType & and returning bool
+    //
+    //  returns
+    //      true if every value was visited
+    //
+    //  note
+    //  - the walk keeps its own stack of pending nodes rather than recursing, since
+    //    the tree can be as deep as it is large
+    //
+
+    template <typename Visitor>
+    bool traverseWhile(Visitor &&visit) {
+        std::vector<TreeNode<TreeType> *>
+            stack;
+        TreeNode<TreeType>
+            *node = root;
+
+        stack.reserve(height() + 1);
+
+        while (node != nullptr || !stack.empty()) {
+            // stack up the path to the leftmost node not yet visited
+            for (; node != nullptr; node = node->left)
+                stack.push_back(node);
+
+            node = stack.back();
+            stack.pop_back();
+
+            // visit it, then do its right subtree
+            if (!visit(node->datum))
+                return false;
+
+            node = node->right;
+        }
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------------
+    //  FrozenTree<TreeType,int32_t> SortedLinearList<TreeType>::freeze()
+    //      take a read-only snapshot of the list, laid out for fast lookups
+    //
+    //  returns
+    //      a FrozenTree (see frozenTree.h) mapping each value to its rank, so its
+    //      search() answers what search() here would
+    //
+    //  note
+    //  - with duplicate values, the snapshot gives the rank of the first one
+    //
+
+    FrozenTree<TreeType,int32_t> freeze() {
+
+        return FrozenTree<TreeType,int32_t>(size(),[this](auto &&emit) {
+            int32_t
+                pos = 0;
+
+            traverse([&](TreeType &datum) { emit(datum,pos++); });
+        });
+    }
 
     //-----------------------------------------------------------------------------
     //  void SortedLinearList<TreeType>::insert(TreeType val)
     //      insert a value into the list
     //
     //  parameter
-    //      val - value to be inserted
+    //      val - value to be inserted; moved from if passed as an rvalue
     //
 
-    void insert(const TreeType &val) {
+    void insert(const TreeType &val) { emplace(val); }
+    void insert(TreeType &&val) { emplace(std::move(val)); }
+
+    //-----------------------------------------------------------------------------
+    //  void SortedLinearList<TreeType>::emplace(Args &&...args)
+    //      insert the value built from args
+    //
+    //  parameter
+    //      args - forwarded to a TreeType constructor
+    //
+
+    template <typename... Args>
+    void emplace(Args &&...args) {
         TreeNode<TreeType>
             *newNode;
 
         // create and populate a new node
-        newNode = new TreeNode<TreeType>;
-        newNode->datum = val;
+        newNode = nodes.allocate();
+        newNode->datum = TreeType(std::forward<Args>(args)...);
         newNode->left = newNode->right = nullptr;
         newNode->count = 1;
         newNode->height = 0;
 
-        // recursively insert it into the tree
+        // insert it into the tree
         root = prvInsert(root,newNode);
     }
 
+    //-----------------------------------------------------------------------------
+    //  void SortedLinearList<TreeType>::buildFromSorted(const TreeType *data,
+    //          int32_t n)
+    //      replace the list contents with a perfectly balanced tree, in O(n)
+    //
+    //  parameters
+    //      data - values to store, in sorted order
+    //         n - number of values
+    //
+    //  throws
+    //      invalid_argument if n is negative or data is not sorted
+    //
+
+    void buildFromSorted(const TreeType *data,int32_t n) {
+
+        if (n < 0)
+            throw std::invalid_argument("buildFromSorted: negative count");
+
+        // make sure the input really is sorted
+        for (int32_t i = 1; i < n; i++)
+            if (data[i] < data[i-1])
+                throw std::invalid_argument("buildFromSorted: data not sorted");
+
+        clear();
+
+        root = prvBuild([&data](TreeType &datum) { datum = *data++; },n);
+    }
+
+    //-----------------------------------------------------------------------------
+    //  void SortedLinearList<TreeType>::saveTo(std::ostream &os,bool delta)
+    //      write the list to a stream in the snapshot format of snapshot.h
+    //
+    //  parameters
+    //         os - stream to write to
+    //      delta - store each value as its distance from the one before; the
+    //              default for integer values, and only allowed for them
+    //
+    //  throws
+    //      invalid_argument if delta is asked of non-integer values
+    //      runtime_error if the stream fails
+    //
+
+    void saveTo(std::ostream &os,bool delta=snapshotCanDelta<TreeType>()) {
+        SnapshotWriter<TreeType>
+            out(os,delta,0,size());
+
+        traverse([&out](TreeType &datum) { out.putKey(datum); });
+
+        out.finish();
+    }
+
+    //-----------------------------------------------------------------------------
+    //  void SortedLinearList<TreeType>::loadFrom(std::istream &is)
+    //      replace the list contents with a snapshot written by saveTo(), building
+    //      a perfectly balanced tree as the values arrive: O(n) time, and no
+    //      memory beyond the tree but the stream buffer and the recursion. a
+    //      stream that cannot seek has its values buffered first, since the
+    //      count in its header can't be checked
+    //
+    //  parameter
+    //      is - stream to read from
+    //
+    //  throws
+    //      invalid_argument if the snapshot is bad. a bad header, or a seekable
+    //      stream too short for the count in it, leaves the list alone; bad data
+    //      leaves it empty
+    //      length_error if the snapshot holds more values than a list can
+    //
+
+    void loadFrom(std::istream &is) {
+        SnapshotReader<TreeType>
+            in(is,0,false);
+
+        if (in.size() > INT32_MAX)
+            throw std::length_error("loadFrom: snapshot too large for a list");
+
+        clear();
+
+        if (in.sizeChecked())
+            root = prvBuild([&in](TreeType &datum) { in.getKey(datum); },in.size());
+        else {
+            // the count can't be checked against the stream, so the values are
+            // read first and the list is sized by how many turn up
+            std::vector<TreeType>
+                buffered;
+            TreeType
+                datum;
+            uint32_t
+                next = 0;
+
+            while (buffered.size() < in.size()) {
+                in.getKey(datum);
+                if (in.failed())
+                    break;
+                buffered.push_back(datum);
+            }
+
+            if (!in.failed())
+                root = prvBuild([&buffered,&next](TreeType &d) { d = buffered[next++]; },(int32_t)buffered.size());
+        }
+
+        try {
+            in.finish();
+        } catch (const std::invalid_argument &) {
+            clear();
+            throw;
+        }
+    }
+
     //-----------------------------------------------------------------------------
     //  void SortedLinearList<TreeType>::remove(TreeType key)
     //      remove a value from the list
@@ -222,60 +576,145 @@ public:
     void remove(const TreeType &key) {
 
         try {
-            // recursively detach the key node from the tree
+            // detach the key node from the tree
             root = prvRemove(root, key);
 
             // if the key was found, ntbd will be set and detached from the tree;
-            // delete the node
-            delete ntbd;
+            // give the node back
+            nodes.release(ntbd);
         } catch (const std::domain_error &e) {
             throw e;
         }
     }
 
+    //-----------------------------------------------------------------------------
+    //  void SortedLinearList<TreeType>::isValidTree()
+    //      check order, node counts and heights and, in AVL_BALANCED mode, balance
+    //
+    //  throws
+    //      logic_error describing the first problem found
+    //
+
+    void isValidTree() {
+        std::vector<TreeNode<TreeType> *>
+            visited,
+            stack;
+        TreeNode<TreeType>
+            *node;
+        TreeType
+            *prev = nullptr;
+        int32_t
+            balance;
+
+        // values must come out of an inorder walk in sorted order
+        traverseWhile([&prev](TreeType &datum) {
+            if (prev != nullptr && datum < *prev)
+                throw std::logic_error("values out of order");
+            prev = &datum;
+            return true;
+        });
+
+        // list the nodes parents first, then check them children first
+        if (root != nullptr)
+            stack.push_back(root);
+        while (!stack.empty()) {
+            node = stack.back();
+            stack.pop_back();
+            visited.push_back(node);
+            if (node->left != nullptr)
+                stack.push_back(node->left);
+            if (node->right != nullptr)
+                stack.push_back(node->right);
+        }
+
+        for (auto it = visited.rbegin(); it != visited.rend(); ++it) {
+            node = *it;
+
+            if (node->count != 1 + prvCount(node->left) + prvCount(node->right))
+                throw std::logic_error("wrong node count");
+            if (node->height != 1 + std::max(prvHeight(node->left),prvHeight(node->right)))
+                throw std::logic_error("wrong height");
+
+            balance = prvHeight(node->left) - prvHeight(node->right);
+            if (mode == AVL_BALANCED && (balance < -1 || balance > 1))
+                throw std::logic_error("subtree heights differ by more than one");
+        }
+    }
+
 private:
     //-----------------------------------------------------------------------------
     //  void SortedLinearList<TreeType>::prvClear(TreeNode<TreeType> *r)
-    //      remove r and both subtrees via postorder traversal
+    //      remove r and both subtrees
     //
     //  parameter
     //      r - root of subtree being deleted
     //
+    //  note
+    //  - no recursion and no extra memory, so a degenerate tree can't overflow
+    //    the stack: while r has a left child, rotate it up; once it has none, r
+    //    can go, and its right subtree takes its place. every node is rotated
+    //    past at most once, so this is O(n)
+    //
 
     void prvClear(TreeNode<TreeType> *r) {
-
-        // if r is null, nothing to do
-        if (r != nullptr) {
-            prvClear(r->left);      // delete the subtrees first
-            prvClear(r->right);
-            delete r;               // then delete r
-        }
+        TreeNode<TreeType>
+            *next;
+
+        while (r != nullptr)
+            if (r->left != nullptr) {
+                next = r->left;
+                r->left = next->right;
+                next->right = r;
+                r = next;
+            } else {
+                next = r->right;
+                nodes.release(r);
+                r = next;
+            }
     }
 
     //-----------------------------------------------------------------------------
-    //  void SortedLinearList<TreeType>::prvTraverse(TreeNode<TreeType> *r,
-    //        void (*fp)(TreeType &))
-    //      traverse the list, calling fp() with each value in sorted order
+    //  TreeNode<TreeType> *SortedLinearList<TreeType>::prvBuild(Fill &&fill,
+    //          int32_t n)
+    //      build a perfectly balanced tree from n sorted values
     //
     //  parameters
-    //       r - root of subtree to traverse
-    //      fp - function to call with datum passed to it
+    //      fill - callable taking a TreeType &, which it sets to the next value;
+    //             called once per node, in sorted order
+    //         n - number of values in this subtree
+    //
+    //  returns
+    //      root of the new subtree
     //
 
-    void prvTraverse(TreeNode<TreeType> *r,void (*fp)(TreeType &)) {
+    template <typename Fill>
+    TreeNode<TreeType> *prvBuild(Fill &&fill,int32_t n) {
+        TreeNode<TreeType>
+            *r;
+        int32_t
+            mid = n / 2;
 
-        // no tree? no work.
-        if (r != nullptr) {
-            prvTraverse(r->left,fp);    // recursively traverse to the left
-            (*fp)(r->datum);            // pass datum to function
-            prvTraverse(r->right,fp);   // recursively traverse to the right
-        }
+        // no values? no tree.
+        if (n == 0)
+            return nullptr;
+
+        // middle value becomes the root, halves become the subtrees; the left half
+        // is built first so values are taken in order
+        r = nodes.allocate();
+        r->left = prvBuild(fill,mid);
+        fill(r->datum);
+        r->right = prvBuild(fill,n-mid-1);
+
+        // set node count and tree height
+        prvAdjust(r);
+
+        return r;
     }
 
     //-----------------------------------------------------------------------------
     //  TreeNode<TreeType> *SortedLinearList<TreeType>::prvInsert(
     //          TreeNode<TreeType> *r,TreeNode<TreeType> *newNode)
-    //      recursively add a new node to the given (sub)tree
+    //      add a new node to the given (sub)tree
     //
     //  parameters
     //            r - root of subtree that will contain newNode
@@ -284,22 +723,64 @@ private:
     //  returns
     //      root of the resulting tree... newNode if r is null, r otherwise
     //
+    //  note
+    //  - two walks down the tree, no recursion: the first finds how deep newNode
+    //    will land, the second bumps each count and raises each height to cover it
+    //  - in AVL_BALANCED mode the path is kept instead and retraced bottom-up,
+    //    since rotations can change heights anywhere along it
+    //
 
     TreeNode<TreeType> *prvInsert(TreeNode<TreeType> *r,TreeNode<TreeType> *newNode) {
+        TreeNode<TreeType>
+            *node,
+            *next;
+        int32_t
+            depth;
 
         // if current tree doesn't exist, then the new tree is just the new node
         if (r == nullptr)
             return newNode;
 
-        // recursively insert to the left or right
-        // attach what is returned as the left or right child
-        if (newNode->datum < r->datum)
-            r->left = prvInsert(r->left,newNode);
-        else
-            r->right = prvInsert(r->right,newNode);
+        if (mode == AVL_BALANCED) {
+            path.clear();
 
-        // update node count and tree height
-        prvAdjust(r);
+            // walk down to the empty spot, remembering the way
+            for (node = r; node != nullptr;
+                 node = (newNode->datum < node->datum) ? node->left : node->right)
+                path.push_back(node);
+
+            // attach newNode, then fix up the path
+            if (newNode->datum < path.back()->datum)
+                path.back()->left = newNode;
+            else
+                path.back()->right = newNode;
+
+            return prvRetrace(r);
+        }
+
+        // find the depth (in edges from r) where newNode will be attached
+        depth = 0;
+        for (node = r; node != nullptr;
+             node = (newNode->datum < node->datum) ? node->left : node->right)
+            depth++;
+
+        // walk down again, updating node count and tree height on the way
+        for (node = r; ; node = next, depth--) {
+            node->count++;
+            if (node->height < depth)
+                node->height = depth;
+
+            // attach newNode at the first empty spot
+            if (newNode->datum < node->datum) {
+                if ((next = node->left) == nullptr) {
+                    node->left = newNode;
+                    break;
+                }
+            } else if ((next = node->right) == nullptr) {
+                node->right = newNode;
+                break;
+            }
+        }
 
         // return root of tree
         return r;
@@ -308,7 +789,7 @@ private:
     //-----------------------------------------------------------------------------
     //  TreeNode<TreeType> *SortedLinearList<TreeType>::prvRemove(
     //          TreeNode<TreeType> *r,const TreeType &key)
-    //      recursively remove a value from the tree
+    //      remove a value from the tree
     //
     //  parameters
     //        r - root of (sub)tree to remove from
@@ -320,82 +801,203 @@ private:
     //  throws
     //      domain_error if key isn't in the tree
     //
+    //  note
+    //  - the nodes passed on the way down are kept in path so their count and
+    //    height can be adjusted (and rebalanced) bottom-up afterwards
+    //
 
     TreeNode<TreeType> *prvRemove(TreeNode<TreeType> *r,const TreeType &key) {
         TreeNode<TreeType>
-            *tmpNode;
-        TreeType
-            tmp;
+            *node,
+            *tmpNode,
+            **link,
+            **tmpLink;
+        size_t
+            nodePos;
 
-        // no tree? that's a problem, throw an error
-        if (r == nullptr)
-            throw std::domain_error("Key ["+std::to_string(key)+"] not found");
+        path.clear();
 
-        // is the key smaller?
-        if (key < r->datum) {
-            r->left = prvRemove(r->left, key);      // yes, recurse to the left
+        // link is the pointer that leads to node, so node can be replaced
+        link = &r;
+        node = r;
 
-        // is the key larger?
-        } else if (key > r->datum) {
-            r->right = prvRemove(r->right,key);     // yes, recurse to the right
+        while (true) {
+            // no tree? that's a problem, throw an error
+            if (node == nullptr)
+                throw std::domain_error("Key ["+keyText(key)+"] not found");
 
-        // do we have a match?
-        } else {
+            // is the key smaller?
+            if (key < node->datum) {
+                path.push_back(node);
+                link = &node->left;                 // yes, go to the left
 
-            ntbd = r;                               // remember the node
+            // is the key larger?
+            } else if (key > node->datum) {
+                path.push_back(node);
+                link = &node->right;                // yes, go to the right
 
-            // no left child?
-            if (r->left == nullptr) {
+            // do we have a match with at most one child?
+            } else if (node->left == nullptr || node->right == nullptr) {
 
-                // no right child either?
-                if (r->right == nullptr)
-                    return nullptr;                 // deleting a leaf, return null
-                else
-                    return r->right;                // only a right child, return it
+                ntbd = node;                        // remember the node
+
+                // replace it with its only child (or null, for a leaf)
+                *link = (node->left == nullptr) ? node->right : node->left;
+
+                break;
+
+            // a match with two children
             } else {
-                // no right child?
-                if (r->right == nullptr)
-                    return r->left;                 // only a left child, return it
-                else {
-                    // choose taller subtree to swap into
-                    if (r->left->height > r->right->height) {
-                        // find largest node in left subtree
-                        for (tmpNode = r->left; tmpNode->right != nullptr;
-                             tmpNode = tmpNode->right);
-
-                        // swap ntbd and largest node in left subtree
-                        tmp = r->datum;
-                        r->datum = tmpNode->datum;
-                        tmpNode->datum = tmp;
-
-                        // recursively remove to the left
-                        r->left = prvRemove(r->left,key);
-
-                    } else {
-
-                        // find smallest node in right subtree
-                        for (tmpNode = r->right; tmpNode->left != nullptr;
-                             tmpNode = tmpNode->left);
-
-                        // swap ntbd and smallest node in right subtree
-                        tmp = r->datum;
-                        r->datum = tmpNode->datum;
-                        tmpNode->datum = tmp;
-
-                        // recursively remove to the right
-                        r->right = prvRemove(r->right,key);
-                    }
+                ntbd = node;                        // remember the node
+                nodePos = path.size();
+                path.push_back(node);               // its replacement goes here
+
+                // choose taller subtree to take the replacement from
+                if (node->left->height > node->right->height) {
+                    // find largest node in left subtree, and the link to it
+                    for (tmpLink = &node->left; (*tmpLink)->right != nullptr;
+                         tmpLink = &(*tmpLink)->right)
+                        path.push_back(*tmpLink);
+
+                    // detach it, leaving its left child in its place
+                    tmpNode = *tmpLink;
+                    *tmpLink = tmpNode->left;
+                } else {
+                    // find smallest node in right subtree, and the link to it
+                    for (tmpLink = &node->right; (*tmpLink)->left != nullptr;
+                         tmpLink = &(*tmpLink)->left)
+                        path.push_back(*tmpLink);
+
+                    // detach it, leaving its right child in its place
+                    tmpNode = *tmpLink;
+                    *tmpLink = tmpNode->right;
                 }
+
+                // splice the node found into ntbd's place; no data moves
+                tmpNode->left = node->left;
+                tmpNode->right = node->right;
+                *link = tmpNode;
+                path[nodePos] = tmpNode;
+
+                break;
+            }
+
+            node = *link;
+        }
+
+        // adjust count and height information, bottom-up, and return the root of
+        // the resulting tree
+        return prvRetrace(r);
+    }
+
+    //-----------------------------------------------------------------------------
+    //  TreeNode<TreeType> *SortedLinearList<TreeType>::prvRetrace(
+    //          TreeNode<TreeType> *r)
+    //      adjust (and in AVL_BALANCED mode, rebalance) the nodes in path,
+    //      bottom-up, after an insert or remove below them
+    //
+    //  parameter
+    //      r - root of the tree; path[0] if path is not empty
+    //
+    //  returns
+    //      root of the tree, which a rotation at the top may have changed
+    //
+
+    TreeNode<TreeType> *prvRetrace(TreeNode<TreeType> *r) {
+        TreeNode<TreeType>
+            *node,
+            *newNode,
+            *parent;
+
+        for (size_t i = path.size(); i-- > 0; ) {
+            node = path[i];
+
+            if (mode != AVL_BALANCED) {
+                prvAdjust(node);
+                continue;
+            }
+
+            // a rotation replaces node, so whatever pointed at it must follow
+            if ((newNode = prvBalance(node)) != node) {
+                if (i == 0)
+                    r = newNode;
+                else if ((parent = path[i-1])->left == node)
+                    parent->left = newNode;
+                else
+                    parent->right = newNode;
             }
         }
 
-        // adjust count and height information for new root
+        return r;
+    }
+
+    //-----------------------------------------------------------------------------
+    //  TreeNode<TreeType> *SortedLinearList<TreeType>::prvBalance(
+    //          TreeNode<TreeType> *r)
+    //      restore the AVL property at r, whose subtrees are already balanced
+    //      and differ in height by at most two
+    //
+    //  parameter
+    //      r - root of subtree to balance
+    //
+    //  returns
+    //      root of the balanced subtree
+    //
+
+    TreeNode<TreeType> *prvBalance(TreeNode<TreeType> *r) {
+        int32_t
+            balance = prvHeight(r->left) - prvHeight(r->right);
+
+        // left side too tall? if its inner grandchild is the tall one, turn that
+        // outward first
+        if (balance > 1) {
+            if (prvHeight(r->left->left) < prvHeight(r->left->right))
+                r->left = prvRotateLeft(r->left);
+            return prvRotateRight(r);
+        }
+
+        // same on the right side
+        if (balance < -1) {
+            if (prvHeight(r->right->right) < prvHeight(r->right->left))
+                r->right = prvRotateRight(r->right);
+            return prvRotateLeft(r);
+        }
+
         prvAdjust(r);
 
-        // return the root of the resulting tree
         return r;
     }
 
+    TreeNode<TreeType> *prvRotateLeft(TreeNode<TreeType> *r) {
+        TreeNode<TreeType>
+            *newRoot = r->right;
+
+        r->right = newRoot->left;
+        newRoot->left = r;
+
+        prvAdjust(r);
+        prvAdjust(newRoot);
+
+        return newRoot;
+    }
+
+    TreeNode<TreeType> *prvRotateRight(TreeNode<TreeType> *r) {
+        TreeNode<TreeType>
+            *newRoot = r->left;
+
+        r->left = newRoot->right;
+        newRoot->right = r;
+
+        prvAdjust(r);
+        prvAdjust(newRoot);
+
+        return newRoot;
+    }
+
+    // node count and height of a possibly empty subtree
+    static int32_t prvCount(TreeNode<TreeType> *r) { return (r == nullptr) ? 0 : r->count; }
+    static int32_t prvHeight(TreeNode<TreeType> *r) { return (r == nullptr) ? -1 : r->height; }
+
     //-----------------------------------------------------------------------------
     //  void SortedLinearList<TreeType>::prvAdjust(TreeNode<TreeType> *r)
     //      compute node count and height of tree rooted at r
@@ -427,4 +1029,13 @@ private:
     TreeNode<TreeType>
         *root,              // root of the tree
         *ntbd;              // node to be deleted, used by remove / prvRemove
+
+    BalanceMode
+        mode;               // whether to rebalance after insert and remove
+
+    std::vector<TreeNode<TreeType> *>
+        path;               // nodes above the insert or removal point
+
+    NodeAllocator
+        nodes;              // where nodes come from and go back to
 };
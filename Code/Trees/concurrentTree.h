@@ -0,0 +1,310 @@
+//
+// concurrentTree.h
+//      a RedBlackTree that any number of threads can read while one thread writes
+//
+// Readers take no lock. The writer keeps a sequence count that is odd while it is
+// changing the tree and even otherwise; a reader notes the count, reads, and tries again
+// if the count moved in the meantime. A reader can therefore be looking at a tree in
+// mid-update, so every index it follows is checked against the pool's capacity and
+// every walk is bounded in length before its result is trusted. The pool never frees
+// storage while the tree is alive, so such a reader only ever sees stale data, never
+// freed memory.
+//
+// Keys and values are copied out by readers while the writer may be overwriting them,
+// so both must be trivially copyable. The tree has its own pool; no other tree can grow
+// it behind the readers' backs.
+//
+
+#ifndef CONCURRENTTREE_H
+#define CONCURRENTTREE_H
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include "redBlackTree.h"
+
+static const uint32_t
+    READ_SPIN_LIMIT = 64;
+
+template <typename KeyType,typename ValueType,typename Layout=SoALayout>
+class ConcurrentRedBlackTree {
+    static_assert(std::is_trivially_copyable<KeyType>::value &&
+                  std::is_trivially_copyable<ValueType>::value,
+                  "ConcurrentRedBlackTree needs trivially copyable keys and values");
+public:
+    explicit ConcurrentRedBlackTree(uint32_t _cap=DEFAULT_INIT_CAPACITY) : tree(_cap,PRIVATE_POOL) {
+
+        seq.store(0);
+    }
+
+    //
+    // writer side: at most one thread at a time
+    //
+
+    bool insertOrAssign(const KeyType &k,const ValueType &v) {
+        WriteSection
+            ws(seq);
+
+        return tree.insertOrAssign(k,v);
+    }
+
+    void remove(const KeyType &k) {
+        WriteSection
+            ws(seq);
+
+        tree.remove(k);
+    }
+
+    void insertBatch(const KeyType *ks,const ValueType *vs,uint32_t n) {
+        WriteSection
+            ws(seq);
+
+        tree.insertBatch(ks,vs,n);
+    }
+
+    void buildFromSorted(const KeyType *ks,const ValueType *vs,uint32_t n) {
+        WriteSection
+            ws(seq);
+
+        tree.buildFromSorted(ks,vs,n);
+    }
+
+    void clear() {
+        WriteSection
+            ws(seq);
+
+        tree.clear();
+    }
+
+    void reserve(uint32_t n) {
+        WriteSection
+            ws(seq);
+
+        tree.reserve(n);
+    }
+
+    //
+    // reader side: any number of threads, alongside the writer
+    //
+
+    // copy the value for k into v; false if k is not in the tree
+    bool search(const KeyType &k,ValueType &v) {
+        ValueType
+            tmp;
+        bool
+            found = false;
+
+        prvRead([&]() { return prvSearch(k,tmp,found); });
+
+        if (found)
+            v = tmp;
+
+        return found;
+    }
+
+    uint32_t size() {
+        uint32_t
+            n = 0;
+
+        prvRead([&]() {
+            uint32_t
+                r = tree.root;
+
+            if (r == NULL_INDEX)
+                n = 0;
+            else if (tree.pool->readerCanSee(r))
+                n = tree.counts(r);
+            else
+                return false;
+
+            return true;
+        });
+
+        return n;
+    }
+
+    // number of keys in [lo,hi]
+    uint32_t countRange(const KeyType &lo,const KeyType &hi) {
+        uint32_t
+            below,
+            upTo;
+
+        if (hi < lo)
+            return 0;
+
+        prvRead([&]() { return prvCountBelow(lo,false,below) && prvCountBelow(hi,true,upTo); });
+
+        return upTo - below;
+    }
+
+    // copy up to maxN pairs with keys in [lo,hi] into ks/vs, in order; returns the count
+    uint32_t readRange(const KeyType &lo,const KeyType &hi,KeyType *ks,ValueType *vs,uint32_t maxN) {
+        uint32_t
+            n = 0;
+
+        if (hi < lo)
+            return 0;
+
+        prvRead([&]() { return prvReadRange(lo,hi,ks,vs,maxN,n); });
+
+        return n;
+    }
+
+private:
+    // marks the sequence count odd for its lifetime, even if the update throws
+    struct WriteSection {
+        explicit WriteSection(std::atomic<uint32_t> &_seq) : seq(_seq) {
+
+            seq.store(seq.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        ~WriteSection() { seq.store(seq.load(std::memory_order_relaxed) + 1,std::memory_order_release); }
+
+        std::atomic<uint32_t>
+            &seq;
+    };
+
+    // run attempt until it completes without the writer having touched the tree. attempt
+    // returns false if it saw something inconsistent and must start over
+    template <typename Attempt>
+    void prvRead(Attempt &&attempt) {
+
+        for (uint32_t spins=0;;spins++) {
+            uint32_t
+                before = seq.load(std::memory_order_acquire);
+
+            if ((before & 1) == 0 && attempt()) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq.load(std::memory_order_relaxed) == before)
+                    return;
+            }
+
+            if (spins >= READ_SPIN_LIMIT)
+                std::this_thread::yield();
+        }
+    }
+
+    bool prvSearch(const KeyType &k,ValueType &v,bool &found) {
+        uint32_t
+            r = tree.root;
+
+        REPI(depth,0,RB_MAX_DEPTH) {
+            if (r == NULL_INDEX) {
+                found = false;
+                return true;
+            }
+
+            if (!tree.pool->readerCanSee(r))
+                return false;
+
+            KeyType
+                key = tree.keys(r);
+
+            if (k == key) {
+                v = tree.values(r);
+                found = true;
+                return true;
+            }
+
+            r = (k < key) ? tree.left(r) : tree.right(r);
+        }
+
+        return false;
+    }
+
+    bool prvCountBelow(const KeyType &k,bool inclusive,uint32_t &count) {
+        uint32_t
+            r = tree.root,
+            l;
+
+        count = 0;
+
+        REPI(depth,0,RB_MAX_DEPTH) {
+            if (r == NULL_INDEX)
+                return true;
+
+            if (!tree.pool->readerCanSee(r))
+                return false;
+
+            KeyType
+                key = tree.keys(r);
+
+            if (k < key || (!inclusive && k == key))
+                r = tree.left(r);
+            else {
+                l = tree.left(r);
+                if (l != NULL_INDEX) {
+                    if (!tree.pool->readerCanSee(l))
+                        return false;
+                    count += tree.counts(l);
+                }
+                count++;
+                r = tree.right(r);
+            }
+        }
+
+        return false;
+    }
+
+    // the guarded twin of RedBlackTree::lower_bound followed by Iterator::operator++
+    bool prvReadRange(const KeyType &lo,const KeyType &hi,KeyType *ks,ValueType *vs,uint32_t maxN,
+                      uint32_t &n) {
+        uint32_t
+            path[RB_MAX_DEPTH],
+            depth = 0,
+            found = 0,
+            r = tree.root;
+
+        n = 0;
+
+        while (r != NULL_INDEX) {
+            if (depth == RB_MAX_DEPTH || !tree.pool->readerCanSee(r))
+                return false;
+            path[depth++] = r;
+            if (!(tree.keys(r) < lo)) {
+                found = depth;
+                r = tree.left(r);
+            } else
+                r = tree.right(r);
+        }
+
+        depth = found;
+
+        while (depth > 0 && n < maxN) {
+            r = path[depth-1];
+
+            KeyType
+                key = tree.keys(r);
+
+            if (hi < key)
+                break;
+
+            ks[n] = key;
+            vs[n++] = tree.values(r);
+
+            // step to the successor
+            if ((r = tree.right(r)) != NULL_INDEX) {
+                while (r != NULL_INDEX) {
+                    if (depth == RB_MAX_DEPTH || !tree.pool->readerCanSee(r))
+                        return false;
+                    path[depth++] = r;
+                    r = tree.left(r);
+                }
+            } else
+                do
+                    r = path[--depth];
+                while (depth > 0 && tree.right(path[depth-1]) == r);
+        }
+
+        return true;
+    }
+
+    RedBlackTree<KeyType,ValueType,Layout>
+        tree;
+
+    std::atomic<uint32_t>
+        seq;
+};
+
+#endif //CONCURRENTTREE_H
@@ -0,0 +1,188 @@
+//
+// frozenTree.h
+//      a read-only snapshot of sorted key/value pairs, laid out for fast lookups
+//
+// The keys are stored in Eytzinger order: the implicit complete binary tree of a binary
+// heap, with the root at slot 1 and the children of slot j at 2j and 2j+1. A search walks
+// down that tree with no pointers to chase and no branch to mispredict -- each step is
+// j = 2j + (key[j] < k) -- and since the 2^d descendants d levels below slot j sit side
+// by side, one prefetch fetches the whole level the search will reach a few steps later.
+// The top of the tree shares a handful of cache lines that stay hot across searches.
+//
+// Values are stored in the same order as the keys, so a successful search touches one
+// more slot. rank() and select() go through two index arrays mapping slots to sorted
+// positions and back.
+//
+// RedBlackTree::freeze() and SortedLinearList::freeze() build one from a live tree; it
+// does not see later changes to that tree.
+//
+
+#ifndef FROZENTREE_H
+#define FROZENTREE_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+template <typename KeyType,typename ValueType>
+class FrozenTree {
+public:
+    // n pairs from sorted arrays
+    FrozenTree(const KeyType *ks,const ValueType *vs,uint32_t n) :
+        FrozenTree(n,[ks,vs,n](auto &&emit) {
+            for (uint32_t i=0;i<n;i++)
+                emit(ks[i],vs[i]);
+        }) {}
+
+    // n pairs from walk, which is called once with a callable emit(key,value) and must
+    // call it n times, in key order
+    template <typename Walk>
+    FrozenTree(uint32_t n,Walk &&walk) : nPairs(n),keys(n + 1),values(n + 1),ranks(n + 1),slots(n) {
+        uint64_t
+            j = prvFirstSlot();
+        uint32_t
+            i = 0;
+
+        walk([&](const KeyType &k,const ValueType &v) {
+            if (i == n)
+                throw std::invalid_argument("FrozenTree: more pairs than promised");
+            if (i > 0 && k < keys[slots[i-1]])
+                throw std::invalid_argument("FrozenTree: keys not sorted");
+
+            keys[j] = k;
+            values[j] = v;
+            ranks[j] = i;
+            slots[i++] = j;
+
+            j = prvNextSlot(j);
+        });
+
+        if (i != n)
+            throw std::invalid_argument("FrozenTree: fewer pairs than promised");
+    }
+
+    uint32_t size() const { return nPairs; }
+
+    bool isEmpty() const { return nPairs == 0; }
+
+    bool contains(const KeyType &k) const {
+        uint64_t
+            j = prvBound<false>(k);
+
+        return j != 0 && keys[j] == k;
+    }
+
+    const ValueType &search(const KeyType &k) const {
+        uint64_t
+            j = prvBound<false>(k);
+
+        if (j == 0 || !(keys[j] == k))
+            throw std::domain_error("Search: Key not found");
+
+        return values[j];
+    }
+
+    // position of k in sorted order
+    uint32_t rank(const KeyType &k) const {
+        uint64_t
+            j = prvBound<false>(k);
+
+        if (j == 0 || !(keys[j] == k))
+            throw std::domain_error("Rank: Key not found");
+
+        return ranks[j];
+    }
+
+    // key at position i in sorted order
+    const KeyType &select(uint32_t i) const {
+
+        if (i >= nPairs)
+            throw std::out_of_range("Select: Index " + std::to_string(i) + " is out of range");
+
+        return keys[slots[i]];
+    }
+
+    // number of keys less than k
+    uint32_t countLess(const KeyType &k) const { return prvCountBelow<false>(k); }
+
+    // number of keys in [lo,hi]
+    uint32_t countRange(const KeyType &lo,const KeyType &hi) const {
+
+        if (hi < lo)
+            return 0;
+
+        return prvCountBelow<true>(hi) - prvCountBelow<false>(lo);
+    }
+
+private:
+    // prefetching this many slots ahead of j lands on the descendants of j one cache
+    // line of keys down: four levels for 4-byte keys, three for 8-byte ones
+    static const uint64_t
+        PREFETCH_STRIDE = (sizeof(KeyType) >= 64) ? 1 : 64 / sizeof(KeyType);
+
+    // the slot of the first key not less than k (inclusive: greater than k), or 0 if
+    // there is none. the walk runs off the bottom of the tree; the slot we want is
+    // where it last went left, found by dropping the trailing right turns and then
+    // the left turn itself
+    template <bool inclusive>
+    uint64_t prvBound(const KeyType &k) const {
+        uint64_t
+            j = 1;
+
+        while (j <= nPairs) {
+            __builtin_prefetch(keys.data() + j * PREFETCH_STRIDE);
+            j = 2 * j + (inclusive ? !(k < keys[j]) : (keys[j] < k));
+        }
+
+        return j >> __builtin_ffsll(~j);
+    }
+
+    template <bool inclusive>
+    uint32_t prvCountBelow(const KeyType &k) const {
+        uint64_t
+            j = prvBound<inclusive>(k);
+
+        return (j == 0) ? nPairs : ranks[j];
+    }
+
+    // the leftmost slot, which takes the smallest key
+    uint64_t prvFirstSlot() const {
+        uint64_t
+            j = 1;
+
+        while (2 * j <= nPairs)
+            j *= 2;
+
+        return j;
+    }
+
+    // the slot after j in key order: the leftmost slot of j's right subtree if it has
+    // one, otherwise the nearest ancestor whose left subtree holds j
+    uint64_t prvNextSlot(uint64_t j) const {
+
+        if (2 * j + 1 <= nPairs) {
+            j = 2 * j + 1;
+            while (2 * j <= nPairs)
+                j *= 2;
+            return j;
+        }
+
+        return j >> __builtin_ffsll(~j);
+    }
+
+    uint32_t
+        nPairs;
+
+    std::vector<KeyType>
+        keys;               // slot 1 up; slot 0 is unused
+
+    std::vector<ValueType>
+        values;             // alongside keys
+
+    std::vector<uint32_t>
+        ranks,              // sorted position of each slot
+        slots;              // slot of each sorted position
+};
+
+#endif //FROZENTREE_H
@@ -1,7 +1,19 @@
 #include <iostream>
 #include <random>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
 #include "bstree.h"
 #include "redBlackTree.h"
+#include "concurrentTree.h"
+#include "bPlusTree.h"
 
 using namespace std;
 
@@ -9,31 +21,23 @@ using namespace std;
 
 const uint32_t
     DEFAULT_N_TREES = 4,
-    DEFAULT_N_KEYS = 128,
-    REGULAR_THRESHOLD = 100000;
-
-RedBlackTree<uint64_t,uint32_t>
-    *ordered;
-SortedLinearList<uint64_t>
-    *bst;
+    DEFAULT_N_KEYS = 128;
 
 uint32_t
     nKeys = DEFAULT_N_KEYS;
 
-void orderedInserter(const uint64_t &k,uint32_t &v) {
-
-    (*ordered)[k] = v;
-    if (nKeys <= REGULAR_THRESHOLD)
-        bst->insert(k);
-}
-
 int main(int argc,char *argv[]) {
     RedBlackTree<uint64_t,uint32_t>
         *trees;
+    SortedLinearList<uint64_t>
+        *bst;
     uint64_t
-        **keys;
+        **keys,
+        *sortedKeys;
     uint32_t
         **values,
+        *sortedValues,
+        nSorted,
         nTrees = DEFAULT_N_TREES;
     random_device
         rd;
@@ -44,7 +48,7 @@ int main(int argc,char *argv[]) {
     bool
         okay;
 
-    bst = new SortedLinearList<uint64_t>;
+    bst = new SortedLinearList<uint64_t>(AVL_BALANCED);
 
     // get counts
     REPI(i,1,argc)
@@ -282,8 +286,10 @@ int main(int argc,char *argv[]) {
     // take another tree and copy into cleared tree in order
 
     cout << "\nOrdered insert:" << endl;
-    ordered = trees;
-    trees[1].map(orderedInserter);
+    trees[1].map([&](const uint64_t &k,uint32_t &v) {
+        trees[0][k] = v;
+        bst->insert(k);
+    });
 
     // verify tree properties
 
@@ -294,13 +300,93 @@ int main(int argc,char *argv[]) {
         cout << e.what() << endl;
         okay = false;
     }
-    cout << "valid: " << OPF(okay) << endl;
+    try {
+        bst->isValidTree();
+    } catch (const logic_error &e) {
+        cout << "AVL BST: " << e.what() << endl;
+        okay = false;
+    }
+    cout << "valid: " << OPF(okay && bst->size() == (int32_t)trees[0].size()) << endl;
 
     // check height
 
     cout << "  ordered insert size: " << trees[0].size() << endl;
     cout << "ordered insert height: " << trees[0].height() << endl;
-    cout << "   regular BST height: " << bst->height() << endl;
+    cout << "       AVL BST height: " << bst->height() << endl;
+
+    // sorted input makes an unbalanced BST one long chain; building and destroying
+    // one must not recurse once per level
+
+    {
+        const uint32_t
+            chainLength = 20000;
+        auto
+            chain = new SortedLinearList<uint64_t>;
+
+        REPI(j,0,chainLength)
+            chain->insert(j);
+        okay = chain->size() == (int32_t)chainLength && chain->height() == (int32_t)chainLength - 1;
+        delete chain;
+        cout << "  sorted chain, destroyed: " << OPF(okay) << endl;
+    }
+
+    // rebuild the same contents from sorted arrays
+
+    cout << "\nBulk load:" << endl;
+    sortedKeys = new uint64_t[trees[1].size()];
+    sortedValues = new uint32_t[trees[1].size()];
+    nSorted = 0;
+    trees[1].map([&](const uint64_t &k,uint32_t &v) {
+        sortedKeys[nSorted] = k;
+        sortedValues[nSorted++] = v;
+    });
+
+    trees[0].buildFromSorted(sortedKeys,sortedValues,nSorted);
+
+    okay = true;
+    try {
+        trees[0].isValidRBTree();
+    } catch (const logic_error &e) {
+        cout << e.what() << endl;
+        okay = false;
+    }
+    REPI(j,0,nSorted)
+        try {
+            if (trees[0].search(sortedKeys[j]) != sortedValues[j])
+                okay = false;
+        } catch (const domain_error &e) {
+            okay = false;
+        }
+    cout << "   valid: " << OPF(okay && trees[0].size() == nSorted) << endl;
+    cout << "  height: " << trees[0].height() << endl;
+
+    bst->buildFromSorted(sortedKeys,nSorted);
+    okay = bst->size() == (int32_t)nSorted;
+    REPI(j,0,nSorted)
+        okay = okay && (*bst)[j] == sortedKeys[j];
+    cout << "     BST: " << OPF(okay) << ", height " << bst->height() << endl;
+
+    // a negative count is refused, and the list is left as it was
+    okay = false;
+    try {
+        bst->buildFromSorted(sortedKeys,-1);
+    } catch (const invalid_argument &e) {
+        okay = bst->size() == (int32_t)nSorted;
+    }
+    cout << "  BST, negative count: " << OPF(okay) << endl;
+
+    // early termination and the BST traversal
+
+    nSorted = 0;
+    okay = trees[0].mapWhile([&](const uint64_t &,uint32_t &) { return ++nSorted < 3; }) ==
+           (trees[0].size() < 3);
+    okay = okay && nSorted == min(3u,trees[0].size());
+    nSorted = 0;
+    bst->traverse([&](uint64_t &datum) { okay = okay && datum == sortedKeys[nSorted++]; });
+    cout << "mapWhile(), traverse(): " << OPF(okay && nSorted == (uint32_t)bst->size()) << endl;
+
+    delete[] sortedValues;
+    delete[] sortedKeys;
 
     // remove remaining nodes
 
@@ -342,5 +428,1081 @@ int main(int argc,char *argv[]) {
     }
     cout << " height(): " << OPF(okay) << endl;
 
+    // insert-or-find variants
+
+    cout << "\ntryInsert / insertOrAssign:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+
+        okay = true;
+        REPI(j,0,nKeys)
+            okay = okay && t.tryInsert(keys[0][j],values[0][j]);
+        REPI(j,0,nKeys)
+            okay = okay && !t.tryInsert(keys[0][j],0) && t.search(keys[0][j]) == values[0][j];
+        cout << "      tryInsert(): " << OPF(okay && t.size() == nKeys) << endl;
+
+        okay = true;
+        REPI(j,0,nKeys)
+            okay = okay && !t.insertOrAssign(keys[0][j],j) && t.search(keys[0][j]) == j;
+        okay = okay && t.insertOrAssign(keys[0][0] + 1,7) && t.search(keys[0][0] + 1) == 7;
+        cout << " insertOrAssign(): " << OPF(okay && t.size() == nKeys + 1) << endl;
+
+        okay = false;
+        try {
+            t.remove(keys[0][0] + 2);
+        } catch (const domain_error &e) {
+            okay = true;
+        }
+        try {
+            t.isValidRBTree();
+        } catch (const logic_error &e) {
+            okay = false;
+        }
+        cout << "  remove() absent: " << OPF(okay && t.size() == nKeys + 1) << endl;
+    }
+
+    // order statistics, checked against the sorted keys collected for the bulk load
+
+    cout << "\nOrder statistics:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        auto
+            sorted = new uint64_t[nKeys];
+
+        REPI(j,0,nKeys) {
+            t[keys[0][j]] = values[0][j];
+            sorted[j] = keys[0][j];
+        }
+        sort(sorted,sorted+nKeys);
+
+        okay = true;
+        REPI(j,0,nKeys)
+            okay = okay && t.rank(sorted[j]) == j && t.select(j) == sorted[j] &&
+                   t.countLess(sorted[j]) == j && t.countLess(sorted[j] + 1) == j + 1;
+        cout << "                      rank(), select(): " << OPF(okay) << endl;
+
+        okay = t.countRange(sorted[0],sorted[nKeys-1]) == nKeys &&
+               t.countRange(sorted[nKeys-1],sorted[0]) == 0 &&
+               t.countRange(sorted[nKeys/4],sorted[nKeys/2]) == nKeys/2 - nKeys/4 + 1 &&
+               t.countRange(sorted[0] + 1,sorted[0] + 1) == 0;
+        try {
+            t.select(nKeys);
+            okay = false;
+        } catch (const out_of_range &e) {
+        }
+        cout << "             countLess(), countRange(): " << OPF(okay) << endl;
+
+        okay = true;
+        auto
+            it = t.begin();
+        REPI(j,0,nKeys) {
+            okay = okay && it != t.end() && it.key() == sorted[j] && *it == t.search(sorted[j]);
+            ++it;
+        }
+        okay = okay && it == t.end();
+        for (uint32_t j=nKeys;j>0;j--)
+            okay = okay && (--it).key() == sorted[j-1];
+        cout << "                begin(), end(), ++, --: " << OPF(okay) << endl;
+
+        okay = t.lower_bound(sorted[nKeys/2]).key() == sorted[nKeys/2] &&
+               t.lower_bound(sorted[nKeys-1] + 1) == t.end() &&
+               t.upper_bound(sorted[nKeys-1]) == t.end();
+        if (nKeys > 1)
+            okay = okay && t.upper_bound(sorted[0]).key() == sorted[1];
+        uint32_t
+            inRange = 0;
+        for (auto &v : t.range(sorted[nKeys/4],sorted[nKeys/2])) {
+            okay = okay && v == t.search(sorted[nKeys/4 + inRange]);
+            inRange++;
+        }
+        okay = okay && inRange == nKeys/2 - nKeys/4 + 1;
+        cout << " lower_bound(), upper_bound(), range(): " << OPF(okay) << endl;
+
+        delete[] sorted;
+    }
+
+    // batched insertion, merged in order and rebuilt
+
+    cout << "\ninsertBatch:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+
+        // a small batch into an empty tree, then the rest as one large batch
+        t.insertBatch(keys[0],values[0],nKeys / 2);
+        t.insertBatch(keys[0],values[1],nKeys);
+
+        okay = true;
+        try {
+            t.isValidRBTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        REPI(j,0,nKeys)
+            try {
+                if (t.search(keys[0][j]) != values[1][j])
+                    okay = false;
+            } catch (const domain_error &e) {
+                okay = false;
+            }
+        cout << " insertBatch(): " << OPF(okay && t.size() == nKeys) << endl;
+    }
+
+    // private pools and a shared arena
+
+    cout << "\nPrivate and arena pools:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            priv(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        NodePool<uint64_t,uint32_t>
+            arena;
+        RedBlackTree<uint64_t,uint32_t>
+            a(arena),b(arena);
+
+        priv.reserve(nKeys);
+        arena.reserve(2 * nKeys);
+
+        REPI(j,0,nKeys) {
+            priv[keys[0][j]] = values[0][j];
+            a[keys[1][j]] = values[1][j];
+            b[keys[2 % nTrees][j]] = values[2 % nTrees][j];
+        }
+
+        okay = true;
+        try {
+            priv.isValidRBTree();
+            a.isValidRBTree();
+            b.isValidRBTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        REPI(j,0,nKeys)
+            try {
+                if (priv.search(keys[0][j]) != values[0][j] || a.search(keys[1][j]) != values[1][j] ||
+                    b.search(keys[2 % nTrees][j]) != values[2 % nTrees][j])
+                    okay = false;
+            } catch (const domain_error &e) {
+                okay = false;
+            }
+        okay = okay && priv.size() == nKeys && a.size() == nKeys && b.size() == nKeys;
+        cout << "  private: " << OPF(okay) << endl;
+
+        REPI(j,0,nKeys)
+            a.remove(keys[1][j]);
+        cout << "    arena: " << OPF(a.isEmpty() && b.size() == nKeys) << endl;
+    }
+
+    // one writer churning half the keys while another thread reads the other half
+
+    cout << "\nConcurrent readers:" << endl;
+    {
+        ConcurrentRedBlackTree<uint64_t,uint32_t>
+            ct;
+        atomic<bool>
+            done(false),
+            readOkay(true);
+        auto
+            evenKeys = new uint64_t[nKeys / 2];
+        auto
+            evenValues = new uint32_t[nKeys / 2];
+
+        REPI(j,0,nKeys / 2) {
+            evenKeys[j] = keys[0][2*j];
+            evenValues[j] = values[0][2*j];
+        }
+        ct.insertBatch(evenKeys,evenValues,nKeys / 2);
+
+        thread
+            reader([&]() {
+                uint32_t
+                    v;
+
+                while (!done.load()) {
+                    REPI(j,0,nKeys / 2)
+                        if (!ct.search(evenKeys[j],v) || v != evenValues[j])
+                            readOkay = false;
+                    if (ct.size() < nKeys / 2 || ct.countRange(0,UINT64_MAX) < nKeys / 2)
+                        readOkay = false;
+                }
+            });
+
+        REPI(round,0,16) {
+            REPI(j,0,nKeys / 2)
+                ct.insertOrAssign(keys[0][2*j+1],values[0][2*j+1]);
+            REPI(j,0,nKeys / 2)
+                ct.remove(keys[0][2*j+1]);
+        }
+        done = true;
+        reader.join();
+        cout << "  search() during updates: " << OPF(readOkay.load()) << endl;
+
+        auto
+            outKeys = new uint64_t[nKeys];
+        auto
+            outValues = new uint32_t[nKeys];
+        uint32_t
+            n = ct.readRange(0,UINT64_MAX,outKeys,outValues,nKeys);
+
+        sort(evenKeys,evenKeys + nKeys / 2);
+        okay = n == nKeys / 2 && ct.countRange(0,UINT64_MAX) == n && ct.size() == n;
+        REPI(j,0,n)
+            if (outKeys[j] != evenKeys[j])
+                okay = false;
+        cout << " readRange(), countRange(): " << OPF(okay) << endl;
+
+        delete[] outValues;
+        delete[] outKeys;
+        delete[] evenValues;
+        delete[] evenKeys;
+    }
+
+    // BST nodes from a recycling arena, checked against the heap-allocated list
+
+    cout << "\nBST node arena:" << endl;
+    {
+        SortedLinearList<uint64_t>
+            heapList;
+        SortedLinearList<uint64_t,NodeArena<uint64_t>>
+            arenaList;
+
+        REPI(j,0,nKeys) {
+            heapList.insert(keys[0][j]);
+            arenaList.insert(keys[0][j]);
+        }
+        REPI(j,0,nKeys / 2) {
+            heapList.remove(keys[0][2*j+1]);
+            arenaList.remove(keys[0][2*j+1]);
+        }
+        REPI(j,0,nKeys / 2)
+            arenaList.insert(keys[0][2*j+1]);
+
+        okay = arenaList.size() == (int32_t)nKeys;
+        REPI(j,0,nKeys)
+            okay = okay && arenaList[arenaList.search(keys[0][j])] == keys[0][j];
+        cout << "  recycled nodes: " << OPF(okay) << endl;
+
+        arenaList.clear();
+        okay = arenaList.isEmpty();
+        REPI(j,0,nKeys / 2)
+            arenaList.insert(keys[0][2*j]);
+        okay = okay && arenaList.size() == heapList.size();
+        REPI(j,0,(uint32_t)heapList.size())
+            okay = okay && arenaList[j] == heapList[j];
+        cout << " clear(), reload: " << OPF(okay) << endl;
+    }
+
+    // move-only values and string keys: none of these calls may copy
+
+    cout << "\nMoves and emplace:" << endl;
+    {
+        RedBlackTree<string,unique_ptr<uint32_t>>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        SortedLinearList<string>
+            l(AVL_BALANCED);
+
+        okay = true;
+        REPI(j,0,nKeys) {
+            string
+                k = to_string(keys[0][j]);
+
+            if (j % 3 == 0)
+                okay = okay && t.emplace(string(k),new uint32_t(values[0][j]));
+            else if (j % 3 == 1)
+                okay = okay && t.insertOrAssign(string(k),make_unique<uint32_t>(values[0][j]));
+            else
+                t[string(k)] = make_unique<uint32_t>(values[0][j]);
+
+            l.insert(std::move(k));
+        }
+        REPI(j,0,nKeys / 2)
+            t.remove(to_string(keys[0][2*j]));
+
+        try {
+            t.isValidRBTree();
+            l.isValidTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        REPI(j,0,nKeys / 2)
+            try {
+                okay = okay && *t.search(to_string(keys[0][2*j+1])) == values[0][2*j+1];
+            } catch (const domain_error &e) {
+                okay = false;
+            }
+        okay = okay && t.size() == nKeys / 2 && l.size() == (int32_t)nKeys;
+        cout << "  rvalue keys and values: " << OPF(okay) << endl;
+
+        okay = !t.emplace(to_string(keys[0][1]),nullptr) && *t.search(to_string(keys[0][1])) == values[0][1];
+        l.emplace(3,'x');
+        okay = okay && l[l.search("xxx")] == "xxx";
+        cout << "   emplace() on existing: " << OPF(okay) << endl;
+
+        // a removed or cleared value lets go of what it owns at once, not when its
+        // node is reused; in the shared pool that might be never
+        RedBlackTree<uint64_t,shared_ptr<uint32_t>>
+            privateOwner(DEFAULT_INIT_CAPACITY,PRIVATE_POOL),
+            sharedOwner;
+        auto
+            resource = make_shared<uint32_t>(1);
+
+        okay = true;
+        for (auto owner : {&privateOwner,&sharedOwner}) {
+            (*owner)[1] = resource;
+            (*owner)[2] = resource;
+            owner->remove(1);
+            okay = okay && resource.use_count() == 2;
+            owner->clear();
+            okay = okay && resource.use_count() == 1;
+        }
+        cout << "  remove(), clear() release: " << OPF(okay) << endl;
+    }
+
+    // handles survive growth and other removals
+
+    cout << "\nHandles:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        auto
+            handles = new uint32_t[nKeys];
+
+        REPI(j,0,nKeys) {
+            handles[j] = t.insertHandle(keys[0][j]);
+            t.valueAt(handles[j]) = values[0][j];
+        }
+
+        // grow the pool and churn the tree around the handles
+        REPI(j,0,nKeys)
+            t[keys[1][j]] = j;
+        REPI(j,0,nKeys)
+            t.remove(keys[1][j]);
+
+        okay = true;
+        REPI(j,0,nKeys)
+            okay = okay && t.findHandle(keys[0][j]) == handles[j] && t.keyAt(handles[j]) == keys[0][j] &&
+                   t.valueAt(handles[j]) == values[0][j];
+        okay = okay && t.findHandle(keys[1][0]) == NULL_INDEX && t.begin().handle() == t.findHandle(t.select(0));
+        cout << " findHandle(), keyAt(), valueAt(): " << OPF(okay) << endl;
+
+        REPI(j,0,nKeys / 2)
+            t.erase(handles[2*j]);
+        try {
+            t.isValidRBTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        REPI(j,0,nKeys / 2)
+            okay = okay && t.findHandle(keys[0][2*j]) == NULL_INDEX && t.valueAt(handles[2*j+1]) == values[0][2*j+1];
+        cout << "                         erase(): " << OPF(okay && t.size() == nKeys - nKeys / 2) << endl;
+
+        delete[] handles;
+
+        // a batch big enough to make insertBatch() relink the whole tree must leave
+        // handles and references naming the same elements
+        RedBlackTree<uint64_t,uint32_t>
+            batched(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        uint64_t
+            batchKeys[20];
+        uint32_t
+            batchValues[20];
+
+        for (uint32_t j=100;j>0;j--)
+            batched[j - 1] = (j - 1) / 2;
+        REPI(j,0,20) {
+            batchKeys[j] = 100 + 2 * j;
+            batchValues[j] = j;
+        }
+
+        uint32_t
+            h = batched.findHandle(50),
+            &ref = batched[50];
+
+        batched.insertBatch(batchKeys,batchValues,20);
+        okay = batched.size() == 120 && batched.keyAt(h) == 50 && ref == 25 && batched.findHandle(50) == h;
+
+        // a tie assigns into the existing node
+        batchKeys[0] = 50;
+        batchValues[0] = 7;
+        batched.insertBatch(batchKeys,batchValues,20);
+        okay = okay && batched.size() == 120 && batched.findHandle(50) == h && ref == 7;
+        try {
+            batched.isValidRBTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        cout << "                   insertBatch(): " << OPF(okay) << endl;
+    }
+
+    // the same operations on every node layout
+
+    cout << "\nNode layouts:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t,AoSLayout>
+            aos(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        RedBlackTree<uint64_t,uint32_t,HotColdLayout>
+            hotCold(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        auto
+            check = [&](auto &t) {
+                REPI(j,0,nKeys)
+                    t[keys[0][j]] = values[0][j];
+                REPI(j,0,nKeys / 2)
+                    t.remove(keys[0][2*j]);
+
+                bool
+                    good = t.size() == nKeys - nKeys / 2;
+
+                try {
+                    t.isValidRBTree();
+                } catch (const logic_error &e) {
+                    cout << e.what() << endl;
+                    good = false;
+                }
+                REPI(j,0,nKeys / 2)
+                    good = good && t.findHandle(keys[0][2*j]) == NULL_INDEX &&
+                           t.search(keys[0][2*j+1]) == values[0][2*j+1] &&
+                           t.select(t.rank(keys[0][2*j+1])) == keys[0][2*j+1];
+
+                return good;
+            };
+
+        cout << "           AoSLayout: " << OPF(check(aos)) << endl;
+        cout << "       HotColdLayout: " << OPF(check(hotCold)) << endl;
+    }
+
+    // read-only snapshots answer as the live trees do
+
+    cout << "\nfreeze():" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        SortedLinearList<uint64_t>
+            l(AVL_BALANCED);
+
+        REPI(j,0,nKeys) {
+            t[keys[0][j]] = values[0][j];
+            l.insert(keys[0][j]);
+        }
+
+        auto
+            ft = t.freeze();
+        auto
+            fl = l.freeze();
+
+        okay = ft.size() == t.size() && fl.size() == (uint32_t)l.size();
+        REPI(j,0,nKeys)
+            okay = okay && ft.search(keys[0][j]) == values[0][j] && ft.rank(keys[0][j]) == t.rank(keys[0][j]) &&
+                   ft.select(j) == t.select(j) && ft.countLess(keys[1][j]) == t.countLess(keys[1][j]) &&
+                   fl.search(keys[0][j]) == l.search(keys[0][j]) && fl.contains(keys[1][j]) == (t.findHandle(keys[1][j]) != NULL_INDEX);
+        cout << "  search(), rank(), select(), countLess(): " << OPF(okay) << endl;
+    }
+
+    // the B+-tree engine, checked against a red-black tree holding the same keys
+
+    cout << "\nBPlusTree:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        BPlusTree<uint64_t,uint32_t>
+            bp;
+
+        REPI(j,0,nKeys) {
+            t[keys[0][j]] = values[0][j];
+            bp[keys[0][j]] = values[0][j];
+        }
+        REPI(j,0,nKeys / 2) {
+            t.remove(keys[0][2*j]);
+            bp.remove(keys[0][2*j]);
+        }
+
+        okay = true;
+        try {
+            bp.isValidBPlusTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        cout << "        insert/remove: " << OPF(okay && bp.size() == t.size()) << endl;
+
+        okay = true;
+        REPI(j,0,nKeys)
+            try {
+                if (bp.search(keys[0][j]) != values[0][j] || j % 2 == 0)
+                    okay = false;
+            } catch (const domain_error &e) {
+                if (j % 2 == 1)
+                    okay = false;
+            }
+        cout << "             search(): " << OPF(okay) << endl;
+
+        okay = true;
+        REPI(j,0,nKeys / 2)
+            okay = okay && bp.rank(keys[0][2*j+1]) == t.rank(keys[0][2*j+1]) &&
+                   bp.countLess(keys[1][j]) == t.countLess(keys[1][j]);
+        REPI(j,0,bp.size())
+            okay = okay && bp.select(j) == t.select(j);
+        cout << "  rank(), select(), countLess(): " << OPF(okay) << endl;
+
+        uint32_t
+            j = 0;
+
+        okay = bp.mapWhile([&](const uint64_t &k,uint32_t &v) { return k == t.select(j++) && v == t.search(k); });
+        cout << "                map(): " << OPF(okay && j == t.size()) << endl;
+
+        REPI(j,0,nKeys / 2)
+            bp.remove(keys[0][2*j+1]);
+        cout << "           remove all: " << OPF(bp.isEmpty() && bp.height() == 0) << endl;
+    }
+
+    // batched lookups find what one-at-a-time lookups find, present or not
+
+    cout << "\nsearchBatch():" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        RedBlackTree<uint64_t,uint32_t,HotColdLayout>
+            hotCold(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        vector<uint64_t>
+            probes;
+        vector<uint32_t>
+            handles(2 * nKeys),
+            hotColdHandles(2 * nKeys);
+
+        REPI(j,0,nKeys / 2) {
+            t[keys[0][2*j]] = values[0][2*j];
+            hotCold[keys[0][2*j]] = values[0][2*j];
+        }
+        REPI(j,0,nKeys) {
+            probes.push_back(keys[0][j]);
+            probes.push_back(keys[1][j]);
+        }
+
+        t.searchBatch(probes.data(),handles.data(),2 * nKeys);
+        hotCold.searchBatch<4>(probes.data(),hotColdHandles.data(),2 * nKeys);
+
+        okay = true;
+        REPI(j,0,2 * nKeys)
+            okay = okay && handles[j] == t.findHandle(probes[j]) &&
+                   hotColdHandles[j] == hotCold.findHandle(probes[j]);
+        cout << "  matches findHandle(): " << OPF(okay) << endl;
+
+        t.clear();
+        t.searchBatch(probes.data(),handles.data(),2 * nKeys);
+        okay = all_of(handles.begin(),handles.end(),[](uint32_t h) { return h == NULL_INDEX; });
+        cout << "            empty tree: " << OPF(okay) << endl;
+    }
+
+    // a tree kept in a file comes back as it was last checkpointed
+
+    cout << "\nFile-backed pool:" << endl;
+    {
+        const string
+            path = "main-test.pool";
+        auto
+            holds = [&](RedBlackTree<uint64_t,uint32_t> &t,bool halfRemoved) {
+                bool
+                    good = t.size() == 2 * nKeys - (halfRemoved ? nKeys / 2 : 0);
+
+                try {
+                    t.isValidRBTree();
+                } catch (const logic_error &e) {
+                    cout << e.what() << endl;
+                    good = false;
+                }
+                REPI(j,0,nKeys)
+                    good = good && (t.findHandle(keys[1][j]) != NULL_INDEX) &&
+                           (t.findHandle(keys[0][j]) == NULL_INDEX) == (halfRemoved && j % 2 == 0);
+
+                return good;
+            };
+
+        remove(path.c_str());
+        {
+            RedBlackTree<uint64_t,uint32_t>
+                t(path);
+
+            okay = t.isEmpty();
+            REPI(j,0,nKeys) {
+                t[keys[0][j]] = values[0][j];
+                t[keys[1][j]] = values[1][j];
+            }
+            t.checkpoint();
+        }
+        {
+            RedBlackTree<uint64_t,uint32_t>
+                t(path);
+
+            okay = okay && holds(t,false);
+            REPI(j,0,nKeys)
+                okay = okay && t.search(keys[0][j]) == values[0][j];
+            cout << "       reopen: " << OPF(okay) << endl;
+
+            // the destructor checkpoints these
+            REPI(j,0,nKeys / 2)
+                t.remove(keys[0][2*j]);
+            REPI(j,0,nKeys)
+                t[keys[1][j]] = 0;
+        }
+        {
+            RedBlackTree<uint64_t,uint32_t>
+                t(path);
+
+            okay = holds(t,true);
+            REPI(j,0,nKeys)
+                okay = okay && t.search(keys[1][j]) == 0;
+            cout << "  after close: " << OPF(okay) << endl;
+        }
+
+        okay = true;
+        try {
+            RedBlackTree<uint64_t,uint64_t>
+                t(path);
+
+            okay = false;
+        } catch (const invalid_argument &e) {
+        }
+        try {
+            RedBlackTree<uint64_t,uint32_t,HotColdLayout>
+                t(path);
+
+            okay = false;
+        } catch (const invalid_argument &e) {
+        }
+        cout << "  wrong types: " << OPF(okay) << endl;
+
+        remove(path.c_str());
+    }
+
+    // snapshots round trip through a stream, delta encoded or not
+
+    cout << "\nSnapshots:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL),
+            delta(DEFAULT_INIT_CAPACITY,PRIVATE_POOL),
+            raw(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        SortedLinearList<uint64_t>
+            l(AVL_BALANCED),
+            lCopy;
+        stringstream
+            ss;
+
+        REPI(j,0,nKeys) {
+            t[keys[0][j]] = values[0][j];
+            l.insert(keys[0][j] >> 40);
+        }
+
+        t.saveTo(ss);
+        t.saveTo(ss,false);
+        l.saveTo(ss);
+        delta.loadFrom(ss);
+        raw.loadFrom(ss);
+        lCopy.loadFrom(ss);
+
+        okay = delta.size() == nKeys && raw.size() == nKeys && lCopy.size() == l.size();
+        try {
+            delta.isValidRBTree();
+            raw.isValidRBTree();
+            lCopy.isValidTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        REPI(j,0,nKeys)
+            okay = okay && delta.search(keys[0][j]) == values[0][j] && raw.search(keys[0][j]) == values[0][j] &&
+                   lCopy[j] == l[j];
+        cout << "    saveTo(), loadFrom(): " << OPF(okay) << endl;
+
+        stringstream
+            whole;
+
+        t.saveTo(whole);
+
+        stringstream
+            truncated(whole.str().substr(0,whole.str().size() - 1));
+
+        okay = false;
+        try {
+            delta.loadFrom(truncated);
+        } catch (const invalid_argument &e) {
+            okay = delta.isEmpty();
+        }
+        cout << "  truncated stream throws: " << OPF(okay) << endl;
+
+        // a stream that can't seek, so loadFrom() can't check the count against it
+        struct NoSeekBuf : streambuf {
+            explicit NoSeekBuf(string &s) { setg(&s[0],&s[0],&s[0] + s.size()); }
+        };
+
+        string
+            wholeBytes = whole.str(),
+            inflated = wholeBytes;
+        uint64_t
+            hugeCount = COUNT_MASK;
+
+        // claim far more pairs than the stream holds; neither kind of stream may
+        // size anything by that count
+        memcpy(&inflated[8],&hugeCount,sizeof(hugeCount));
+
+        stringstream
+            inflatedStream(inflated);
+        NoSeekBuf
+            inflatedBuf(inflated),
+            wholeBuf(wholeBytes);
+        istream
+            inflatedNoSeek(&inflatedBuf),
+            wholeNoSeek(&wholeBuf);
+
+        okay = false;
+        try {
+            raw.loadFrom(inflatedStream);
+        } catch (const invalid_argument &e) {
+            okay = raw.size() == nKeys;
+        }
+        try {
+            raw.loadFrom(inflatedNoSeek);
+            okay = false;
+        } catch (const invalid_argument &e) {
+            okay = okay && raw.isEmpty();
+        }
+        delta.loadFrom(wholeNoSeek);
+        okay = okay && delta.size() == nKeys;
+        REPI(j,0,nKeys)
+            okay = okay && delta.search(keys[0][j]) == values[0][j];
+        cout << "   oversized count throws: " << OPF(okay) << endl;
+    }
+
+    // split a tree at its median key and join the halves back together
+
+    cout << "\nSplit and join:" << endl;
+    {
+        NodePool<uint64_t,uint32_t>
+            arena;
+        RedBlackTree<uint64_t,uint32_t>
+            t(arena),less(arena),ge(arena),
+            priv(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        vector<uint64_t>
+            sorted(keys[0],keys[0] + nKeys);
+        uint32_t
+            h;
+
+        sort(sorted.begin(),sorted.end());
+
+        REPI(j,0,nKeys)
+            t[keys[0][j]] = values[0][j];
+        h = t.findHandle(sorted[nKeys - 1]);
+
+        t.split(sorted[nKeys / 2],less,ge);
+
+        okay = t.isEmpty() && less.size() == nKeys / 2 && ge.size() == nKeys - nKeys / 2;
+        try {
+            less.isValidRBTree();
+            ge.isValidRBTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        REPI(j,0,less.size())
+            okay = okay && less.select(j) == sorted[j];
+        REPI(j,0,ge.size())
+            okay = okay && ge.select(j) == sorted[nKeys / 2 + j];
+        cout << "    split(): " << OPF(okay) << endl;
+
+        less.join(ge);
+
+        okay = ge.isEmpty() && less.size() == nKeys && less.keyAt(h) == sorted[nKeys - 1];
+        try {
+            less.isValidRBTree();
+        } catch (const logic_error &e) {
+            cout << e.what() << endl;
+            okay = false;
+        }
+        REPI(j,0,nKeys)
+            okay = okay && less.search(keys[0][j]) == values[0][j];
+        cout << "     join(): " << OPF(okay) << endl;
+
+        priv[sorted[nKeys - 1] + 1] = 0;
+        okay = false;
+        try {
+            less.join(priv);
+        } catch (const invalid_argument &e) {
+            okay = !priv.isEmpty() && less.size() == nKeys;
+        }
+        cout << "  separate pools throw: " << OPF(okay) << endl;
+
+        ge[sorted[0]] = 0;
+        okay = false;
+        try {
+            less.join(ge);
+        } catch (const invalid_argument &e) {
+            okay = ge.size() == 1 && less.size() == nKeys;
+        }
+        cout << "  overlapping keys throw: " << OPF(okay) << endl;
+    }
+
+    // union, intersection and difference of two trees sharing half their keys, checked
+    // against std::map
+
+    cout << "\nSet operations:" << endl;
+    {
+        NodePool<uint64_t,uint32_t>
+            arena;
+        RedBlackTree<uint64_t,uint32_t>
+            a(arena),b(arena);
+        map<uint64_t,uint32_t>
+            inA,inB,expected;
+
+        REPI(j,0,nKeys) {
+            inA[keys[0][j]] = values[0][j];
+            inB[keys[1][j]] = values[1][j];
+            if (j % 2 == 0)
+                inB[keys[0][j]] = values[1][j];
+        }
+
+        auto refill = [&]() {
+            a.clear();
+            b.clear();
+            for (auto &kv : inA)
+                a[kv.first] = kv.second;
+            for (auto &kv : inB)
+                b[kv.first] = kv.second;
+        };
+
+        auto matches = [&](RedBlackTree<uint64_t,uint32_t> &t) {
+            auto
+                it = expected.begin();
+            bool
+                same = b.isEmpty() && t.size() == expected.size();
+
+            try {
+                t.isValidRBTree();
+            } catch (const logic_error &e) {
+                cout << e.what() << endl;
+                same = false;
+            }
+            if (same)
+                t.map([&](const uint64_t &k,uint32_t &v) {
+                    same = same && k == it->first && v == it->second;
+                    ++it;
+                });
+
+            return same;
+        };
+
+        refill();
+        expected = inA;
+        for (auto &kv : inB)
+            expected[kv.first] = kv.second;
+        a.unite(b,4);
+        cout << "      unite(): " << OPF(matches(a)) << endl;
+
+        refill();
+        expected.clear();
+        for (auto &kv : inB)
+            if (inA.count(kv.first) > 0)
+                expected[kv.first] = kv.second;
+        a.intersect(b,4);
+        cout << "  intersect(): " << OPF(matches(a)) << endl;
+
+        refill();
+        expected.clear();
+        for (auto &kv : inA)
+            if (inB.count(kv.first) == 0)
+                expected[kv.first] = kv.second;
+        a.subtract(b,4);
+        cout << "   subtract(): " << OPF(matches(a)) << endl;
+
+        // a key in both trees stays in this tree's node, which takes other's value
+        refill();
+
+        uint32_t
+            shared = a.findHandle(keys[0][0]);
+
+        a.unite(b,4);
+        okay = a.findHandle(keys[0][0]) == shared && a.valueAt(shared) == inB[keys[0][0]];
+        refill();
+        shared = a.findHandle(keys[0][0]);
+        a.intersect(b,4);
+        okay = okay && a.findHandle(keys[0][0]) == shared && a.valueAt(shared) == inB[keys[0][0]];
+        cout << "  shared keys keep handles: " << OPF(okay) << endl;
+
+        // trees big enough that the work is really handed to other threads; the
+        // results must be the ones a single thread gets. a holds the multiples of
+        // 3 and b the multiples of 2, so a sixth of the keys are in both
+        const uint32_t
+            nBig = 4 * SET_OP_PARALLEL_CUTOFF;
+        RedBlackTree<uint64_t,uint32_t>
+            seqA(arena),seqB(arena);
+        vector<uint64_t>
+            bigKeys(nBig);
+        vector<uint32_t>
+            bigValues(nBig);
+
+        auto fillBig = [&](RedBlackTree<uint64_t,uint32_t> &t,uint64_t step,uint32_t bump) {
+            REPI(j,0,nBig) {
+                bigKeys[j] = step * j;
+                bigValues[j] = j + bump;
+            }
+            t.clear();
+            t.buildFromSorted(bigKeys.data(),bigValues.data(),nBig);
+        };
+
+        auto sameAsSequential = [&](void (RedBlackTree<uint64_t,uint32_t>::*op)(RedBlackTree<uint64_t,uint32_t> &,uint32_t)) {
+            vector<pair<uint64_t,uint32_t>>
+                parallel,
+                sequential;
+            bool
+                same;
+
+            fillBig(a,3,0);
+            fillBig(b,2,1);
+            fillBig(seqA,3,0);
+            fillBig(seqB,2,1);
+            (a.*op)(b,4);
+            (seqA.*op)(seqB,1);
+
+            a.map([&parallel](const uint64_t &k,uint32_t &v) { parallel.emplace_back(k,v); });
+            seqA.map([&sequential](const uint64_t &k,uint32_t &v) { sequential.emplace_back(k,v); });
+            same = b.isEmpty() && seqB.isEmpty() && parallel == sequential;
+            try {
+                a.isValidRBTree();
+            } catch (const logic_error &e) {
+                cout << e.what() << endl;
+                same = false;
+            }
+
+            return same;
+        };
+
+        okay = sameAsSequential(&RedBlackTree<uint64_t,uint32_t>::unite);
+        cout << "      big unite(): " << OPF(okay) << endl;
+        okay = sameAsSequential(&RedBlackTree<uint64_t,uint32_t>::intersect);
+        cout << "  big intersect(): " << OPF(okay) << endl;
+        okay = sameAsSequential(&RedBlackTree<uint64_t,uint32_t>::subtract);
+        cout << "   big subtract(): " << OPF(okay) << endl;
+    }
+
+    // bulk builds on several threads, from unsorted keys (half of them given twice,
+    // the second time with a new value) and from sorted ones
+
+    cout << "\nParallel bulk builds:" << endl;
+    {
+        RedBlackTree<uint64_t,uint32_t>
+            t(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        vector<uint64_t>
+            ks(keys[0],keys[0] + nKeys),
+            sorted;
+        vector<uint32_t>
+            vs(values[0],values[0] + nKeys),
+            sortedValues;
+        map<uint64_t,uint32_t>
+            expected;
+
+        REPI(j,0,nKeys / 2) {
+            ks.push_back(keys[0][2*j]);
+            vs.push_back(values[0][2*j] + 1);
+        }
+        REPI(j,0,ks.size())
+            expected[ks[j]] = vs[j];
+
+        auto matches = [&]() {
+            auto
+                it = expected.begin();
+            bool
+                same = t.size() == expected.size();
+
+            try {
+                t.isValidRBTree();
+            } catch (const logic_error &e) {
+                cout << e.what() << endl;
+                same = false;
+            }
+            if (same)
+                t.map([&](const uint64_t &k,uint32_t &v) {
+                    same = same && k == it->first && v == it->second;
+                    ++it;
+                });
+
+            return same;
+        };
+
+        t.buildFromUnsorted(ks.data(),vs.data(),ks.size(),4);
+        cout << "  buildFromUnsorted(): " << OPF(matches()) << endl;
+
+        for (auto &kv : expected) {
+            sorted.push_back(kv.first);
+            sortedValues.push_back(kv.second);
+        }
+        t.clear();
+        t.buildFromSorted(sorted.data(),sortedValues.data(),sorted.size(),4);
+        cout << "    buildFromSorted(): " << OPF(matches()) << endl;
+
+        // enough keys that the sort and the build are both really cut up among
+        // threads, compared against a one-thread buildFromSorted(). the keys are
+        // scattered over all 64 bits, and every other one comes again at the end
+        // with a new value, so duplicates fall in different slices
+        const uint32_t
+            nBig = 4 * std::max(BUILD_PARALLEL_CUTOFF,PARALLEL_MIN_SLICE);
+        RedBlackTree<uint64_t,uint32_t>
+            reference(DEFAULT_INIT_CAPACITY,PRIVATE_POOL);
+        vector<uint64_t>
+            bigKeys,
+            uniqueKeys;
+        vector<uint32_t>
+            bigValues,
+            uniqueValues;
+        vector<pair<uint64_t,uint32_t>>
+            kept;
+
+        REPI(j,0,nBig) {
+            bigKeys.push_back(0x9e3779b97f4a7c15ull * (j + 1));
+            bigValues.push_back(j);
+        }
+        REPI(j,0,nBig / 2) {
+            bigKeys.push_back(bigKeys[2*j]);
+            bigValues.push_back(nBig + j);
+        }
+        REPI(j,0,nBig)
+            kept.emplace_back(bigKeys[j],(j % 2 == 0) ? nBig + j / 2 : j);
+        sort(kept.begin(),kept.end());
+        for (auto &kv : kept) {
+            uniqueKeys.push_back(kv.first);
+            uniqueValues.push_back(kv.second);
+        }
+        reference.buildFromSorted(uniqueKeys.data(),uniqueValues.data(),nBig,1);
+
+        auto matchesReference = [&]() {
+            vector<pair<uint64_t,uint32_t>>
+                built,
+                wanted;
+            bool
+                same = true;
+
+            try {
+                t.isValidRBTree();
+            } catch (const logic_error &e) {
+                cout << e.what() << endl;
+                same = false;
+            }
+            t.map([&built](const uint64_t &k,uint32_t &v) { built.emplace_back(k,v); });
+            reference.map([&wanted](const uint64_t &k,uint32_t &v) { wanted.emplace_back(k,v); });
+
+            return same && built == wanted && wanted == kept;
+        };
+
+        t.buildFromUnsorted(bigKeys.data(),bigValues.data(),bigKeys.size(),4);
+        cout << "  big buildFromUnsorted(): " << OPF(matchesReference()) << endl;
+
+        t.clear();
+        t.buildFromSorted(uniqueKeys.data(),uniqueValues.data(),nBig,4);
+        cout << "    big buildFromSorted(): " << OPF(matchesReference()) << endl;
+    }
+
     return 0;
 }
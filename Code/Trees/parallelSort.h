@@ -0,0 +1,176 @@
+//
+// parallelSort.h
+//      the multi-threaded pieces behind RedBlackTree::buildFromUnsorted()
+//
+// parallelSlices() runs a function over even slices of [0,n), one thread a slice.
+//
+// parallelSortPairs() sorts keys along with their values, stably, so that pairs with
+// equal keys keep the order they came in. Integer keys go through an LSD radix sort,
+// eleven bits at a time: each thread counts the digits in its own slice, a prefix sum
+// over (digit, slice) hands every slice its own stretch of the output for each digit,
+// and each thread then scatters its slice there with no locking at all. A pass in
+// which every key has the same digit moves nothing and is skipped, so keys drawn from
+// a narrow range take fewer passes. Signed keys have their sign bit flipped on the way
+// into a digit so that negative keys sort first. Other keys fall back to
+// std::stable_sort on one thread.
+//
+
+#ifndef PARALLELSORT_H
+#define PARALLELSORT_H
+
+#include <cstdint>
+#include <algorithm>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+static const uint32_t
+    PARALLEL_MIN_SLICE = 1 << 16,       // smaller slices are not worth a thread
+    RADIX_BITS = 11,                    // six passes for 64-bit keys; 8KB of counts a slice
+    RADIX_SIZE = 1 << RADIX_BITS;
+
+// number of slices parallelSlices() should cut n items into for nThreads threads
+inline uint32_t parallelSliceCount(uint32_t n,uint32_t nThreads) {
+
+    return std::max<uint32_t>(1,std::min<uint32_t>(nThreads,n / PARALLEL_MIN_SLICE));
+}
+
+// call fn(t,lo,hi) for each slice t of nSlices even slices [lo,hi) of [0,n), every
+// slice but the last on a thread of its own; returns once all of them are done. if no
+// thread can be had, the slice is run on the calling thread instead
+template <typename Fn>
+void parallelSlices(uint32_t n,uint32_t nSlices,Fn &&fn) {
+    std::vector<std::thread>
+        threads;
+
+    for (uint32_t t=0;t<nSlices;t++) {
+        uint32_t
+            lo = (uint64_t)n * t / nSlices,
+            hi = (uint64_t)n * (t + 1) / nSlices;
+
+        if (t + 1 == nSlices)
+            fn(t,lo,hi);
+        else
+            try {
+                threads.emplace_back([&fn,t,lo,hi]() { fn(t,lo,hi); });
+            } catch (const std::system_error &) {
+                fn(t,lo,hi);
+            }
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+// sort the n pairs of ks/vs into sortedKeys/sortedValues, stably, on up to nThreads
+// threads
+template <typename KeyType,typename ValueType>
+void parallelSortPairs(const KeyType *ks,const ValueType *vs,uint32_t n,KeyType *sortedKeys,ValueType *sortedValues,
+                       uint32_t nThreads) {
+
+    if constexpr (std::is_integral<KeyType>::value && !std::is_same<KeyType,bool>::value) {
+        typedef typename std::make_unsigned<KeyType>::type Bits;
+
+        const Bits
+            flip = std::is_signed<KeyType>::value ? (Bits)1 << (8 * sizeof(KeyType) - 1) : 0;
+        uint32_t
+            nSlices = parallelSliceCount(n,nThreads);
+        std::vector<KeyType>
+            tmpKeys(n);
+        std::vector<ValueType>
+            tmpValues(n);
+        std::vector<uint32_t>
+            counts((size_t)nSlices * RADIX_SIZE);
+        KeyType
+            *srcKeys = sortedKeys,
+            *dstKeys = tmpKeys.data();
+        ValueType
+            *srcValues = sortedValues,
+            *dstValues = tmpValues.data();
+
+        parallelSlices(n,nSlices,[&](uint32_t,uint32_t lo,uint32_t hi) {
+            std::copy(ks + lo,ks + hi,sortedKeys + lo);
+            std::copy(vs + lo,vs + hi,sortedValues + lo);
+        });
+
+        for (uint32_t shift=0;shift<8*sizeof(KeyType);shift+=RADIX_BITS) {
+            auto digit = [flip,shift](const KeyType &k) {
+                return (uint32_t)((((Bits)k ^ flip) >> shift) & (RADIX_SIZE - 1));
+            };
+            uint32_t
+                sum = 0;
+            bool
+                allSame = false;
+
+            parallelSlices(n,nSlices,[&](uint32_t t,uint32_t lo,uint32_t hi) {
+                uint32_t
+                    *count = counts.data() + (size_t)t * RADIX_SIZE;
+
+                std::fill(count,count + RADIX_SIZE,0);
+                for (uint32_t i=lo;i<hi;i++)
+                    count[digit(srcKeys[i])]++;
+            });
+
+            for (uint32_t d=0;d<RADIX_SIZE && !allSame;d++) {
+                uint32_t
+                    total = 0;
+
+                for (uint32_t t=0;t<nSlices;t++)
+                    total += counts[(size_t)t * RADIX_SIZE + d];
+                allSame = total == n;
+            }
+            if (allSame)
+                continue;
+
+            // where slice t's first key with digit d goes
+            for (uint32_t d=0;d<RADIX_SIZE;d++)
+                for (uint32_t t=0;t<nSlices;t++) {
+                    uint32_t
+                        &count = counts[(size_t)t * RADIX_SIZE + d],
+                        c = count;
+
+                    count = sum;
+                    sum += c;
+                }
+
+            parallelSlices(n,nSlices,[&](uint32_t t,uint32_t lo,uint32_t hi) {
+                uint32_t
+                    *next = counts.data() + (size_t)t * RADIX_SIZE;
+
+                for (uint32_t i=lo;i<hi;i++) {
+                    uint32_t
+                        j = next[digit(srcKeys[i])]++;
+
+                    dstKeys[j] = srcKeys[i];
+                    dstValues[j] = srcValues[i];
+                }
+            });
+
+            std::swap(srcKeys,dstKeys);
+            std::swap(srcValues,dstValues);
+        }
+
+        if (srcKeys != sortedKeys)
+            parallelSlices(n,nSlices,[&](uint32_t,uint32_t lo,uint32_t hi) {
+                std::copy(srcKeys + lo,srcKeys + hi,sortedKeys + lo);
+                std::copy(srcValues + lo,srcValues + hi,sortedValues + lo);
+            });
+    } else {
+        std::vector<uint32_t>
+            order(n);
+
+        for (uint32_t i=0;i<n;i++)
+            order[i] = i;
+
+        std::stable_sort(order.begin(),order.end(),[ks](uint32_t a,uint32_t b) { return ks[a] < ks[b]; });
+
+        for (uint32_t i=0;i<n;i++) {
+            sortedKeys[i] = ks[order[i]];
+            sortedValues[i] = vs[order[i]];
+        }
+    }
+}
+
+#endif //PARALLELSORT_H
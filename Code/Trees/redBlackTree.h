@@ -11,128 +11,1441 @@
 #include <cstdint>
 #include <stdexcept>
 #include <cmath>
-
-#define GET_COUNT(n) (((n) == NULL_INDEX) ? 0 : counts[n])
-#define GET_HEIGHT(n) (((n) == NULL_INDEX) ? 0 : heights[n])
-#define IS_RED(n) (((n) == NULL_INDEX) ? false : (colors[n] == NODE_RED))
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <utility>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <type_traits>
+#include <thread>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "frozenTree.h"
+#include "snapshot.h"
+#include "parallelSort.h"
+
+#define GET_COUNT(n) (((n) == NULL_INDEX) ? 0 : counts(n))
+#define IS_RED(n) (((n) == NULL_INDEX) ? false : (colors(n) == NODE_RED))
 #define REPI(ctr,start,limit) for (uint32_t ctr=(start);(ctr)<(limit);ctr++)
 
 static const uint32_t
     NODE_BLACK = 0,
     NODE_RED = 1,
+    COLOR_BIT = 0x80000000,             // a node's color shares a word with its count
+    COUNT_MASK = 0x7fffffff,
     NULL_INDEX = 0xffffffff,
-    DEFAULT_INIT_CAPACITY = 16;
+    DEFAULT_INIT_CAPACITY = 16,
+    POOL_CHUNK_BITS = 10,
+    POOL_CHUNK_SIZE = 1 << POOL_CHUNK_BITS,
+    POOL_CHUNK_MASK = POOL_CHUNK_SIZE - 1,
+    RB_MAX_DEPTH = 128,
+    SEARCH_BATCH_GROUP = 16,            // searchBatch() descents in flight at once
+    SET_OP_PARALLEL_CUTOFF = 1 << 15,   // smaller pieces of a set operation stay on one thread
+    BUILD_PARALLEL_CUTOFF = 1 << 16,    // smaller subtrees of a bulk build stay on one thread
+    POOL_FILE_VERSION = 1,
+    POOL_FILE_HEADER_BYTES = 4096,      // the chunks start this far into a pool file
+    POOL_FILE_MIN_EXTENT = 16,          // chunks in a pool file's first mapping
+    BATCH_REBUILD_RATIO = 12;
+
+//
+// node layouts
+//      how a pool chunk arranges its POOL_CHUNK_SIZE nodes in memory. each layout
+//      supplies a Chunk type with an accessor per node field, and a prefetch() that
+//      asks for the fields a search reads; the pool and the tree only ever go through
+//      those, so a layout is a compile-time choice with no run-time cost.
+//
+//      SoALayout       one array per field. the default
+//      AoSLayout       one record per node holding every field
+//      HotColdLayout   {key, left, right} in one record -- 16 bytes for a 64-bit
+//                      key -- and {count and color, value} in another, so a
+//                      descent touches one cache line per level instead of three
+//
+//      every layout spends 12 bytes per node beyond the key and value: two child
+//      indices, and one word holding the subtree count in its low 31 bits and the
+//      color in the high bit. heights are not stored at all; height() measures the
+//      tree when asked
+//
+//      TAG identifies the layout in a pool file, which must be reopened with the
+//      layout that wrote it
+//
+
+struct SoALayout {
+    static const uint32_t
+        TAG = 1;
+
+    template <typename KeyType,typename ValueType>
+    struct Chunk {
+        uint32_t &left(uint32_t i) { return lefts[i]; }
+        uint32_t &right(uint32_t i) { return rights[i]; }
+        uint32_t &countAndColor(uint32_t i) { return countAndColors[i]; }
+        KeyType &keys(uint32_t i) { return keyArr[i]; }
+        ValueType &values(uint32_t i) { return valueArr[i]; }
+
+        void prefetch(uint32_t i) {
+
+            __builtin_prefetch(keyArr + i);
+            __builtin_prefetch(lefts + i);
+            __builtin_prefetch(rights + i);
+        }
+
+        uint32_t
+            lefts[POOL_CHUNK_SIZE],
+            rights[POOL_CHUNK_SIZE],
+            countAndColors[POOL_CHUNK_SIZE];
+        KeyType
+            keyArr[POOL_CHUNK_SIZE];
+        ValueType
+            valueArr[POOL_CHUNK_SIZE];
+    };
+};
+
+struct AoSLayout {
+    static const uint32_t
+        TAG = 2;
+
+    template <typename KeyType,typename ValueType>
+    struct Chunk {
+        uint32_t &left(uint32_t i) { return nodes[i].left; }
+        uint32_t &right(uint32_t i) { return nodes[i].right; }
+        uint32_t &countAndColor(uint32_t i) { return nodes[i].countAndColor; }
+        KeyType &keys(uint32_t i) { return nodes[i].key; }
+        ValueType &values(uint32_t i) { return nodes[i].value; }
+
+        void prefetch(uint32_t i) { __builtin_prefetch(nodes + i); }
+
+        struct Node {
+            KeyType
+                key;
+            uint32_t
+                left,
+                right,
+                countAndColor;
+            ValueType
+                value;
+        } nodes[POOL_CHUNK_SIZE];
+    };
+};
+
+struct HotColdLayout {
+    static const uint32_t
+        TAG = 3;
+
+    template <typename KeyType,typename ValueType>
+    struct Chunk {
+        uint32_t &left(uint32_t i) { return hot[i].left; }
+        uint32_t &right(uint32_t i) { return hot[i].right; }
+        uint32_t &countAndColor(uint32_t i) { return cold[i].countAndColor; }
+        KeyType &keys(uint32_t i) { return hot[i].key; }
+        ValueType &values(uint32_t i) { return cold[i].value; }
+
+        void prefetch(uint32_t i) { __builtin_prefetch(hot + i); }
+
+        // what a descent reads at every level
+        struct Hot {
+            KeyType
+                key;
+            uint32_t
+                left,
+                right;
+        } hot[POOL_CHUNK_SIZE];
+
+        // what only updates and order statistics need
+        struct Cold {
+            uint32_t
+                countAndColor;
+            ValueType
+                value;
+        } cold[POOL_CHUNK_SIZE];
+    };
+};
+
+template <typename KeyType,typename ValueType,typename Layout>
+class RedBlackTree;
+
+template <typename KeyType,typename ValueType,typename Layout>
+class ConcurrentRedBlackTree;
+
+//
+// NodePool
+//      the node fields used by RedBlackTree, along with the free list threaded through
+//      left. A pool can back one tree, every tree of an instantiation (the shared pool),
+//      or any group of trees the caller binds to it (an arena). An arena must outlive the
+//      trees bound to it.
+//
+//      Nodes live in fixed-size chunks; the high bits of an index select the chunk and
+//      the low bits the slot within it. Growing the pool adds a chunk and never moves an
+//      existing node, so a reference into the pool stays good until its node is freed.
+//      Fresh nodes are handed out from the untouched end of the pool (nextUnused) once
+//      the free list runs dry, so growth does no per-node work either.
+//
+//      Layout decides how the fields of a chunk's nodes are arranged; see SoALayout.
+//
+//      A pool is not thread safe. So that ConcurrentRedBlackTree readers can look at a
+//      pool while its writer grows it, growth publishes the chunk directory before the
+//      new capacity, and an outgrown directory is retired rather than freed.
+//
+//      A pool can also be kept in a file, for trivially copyable keys and values. Its
+//      chunks are then carved out of shared mappings of the file rather than the heap;
+//      since nodes refer to each other by index, never by address, the file can be
+//      mapped anywhere when it is reopened, and the tree in it used as it stands. Each
+//      new mapping is as large as all the earlier ones together, so a pool of n chunks
+//      takes O(log n) of them, and growth still never moves a node. checkpoint() writes
+//      the pool's state and a root into the header page and flushes the file. It is not
+//      atomic: the file can be trusted after a crash only if the tree was not changed
+//      since its last checkpoint
+//
+
+// the first page of a pool file; the chunks follow it, back to back
+struct PoolFileHeader {
+    uint64_t
+        magic;
+    uint32_t
+        version,
+        layoutTag,
+        keyBytes,
+        valueBytes,
+        chunkBytes,
+        capacity,
+        freeListHead,
+        nextUnused,
+        nInUse,
+        nTrees,                 // trees bound to the pool when it was checkpointed
+        root;
+};
+
+static const uint64_t
+    POOL_FILE_MAGIC = 0x4c4f4f5042525446ull;        // "FTRBPOOL"
+
+template <typename KeyType,typename ValueType,typename Layout=SoALayout>
+class NodePool {
+public:
+    // can a key or value own something -- memory, a reference count? then a released
+    // node's pair is reset straight away, not left alive until the node is reused
+    static constexpr bool
+        HOLDS_RESOURCES = !std::is_trivially_destructible<KeyType>::value ||
+                          !std::is_trivially_destructible<ValueType>::value;
+
+    explicit NodePool(uint32_t _cap=DEFAULT_INIT_CAPACITY) {
+
+        prvInit();
+
+        reserve(_cap);
+    }
+
+    // a pool kept in the file at path: reopened as it was at its last checkpoint if the
+    // file exists, created with room for _cap nodes otherwise. throws invalid_argument
+    // if the file was not written by a pool of these types and layout, and
+    // runtime_error if the system will not open, grow or map it
+    NodePool(const std::string &path,uint32_t _cap) {
+        static_assert(std::is_trivially_copyable<KeyType>::value &&
+                      std::is_trivially_copyable<ValueType>::value,
+                      "a file-backed NodePool needs trivially copyable keys and values");
+        struct stat
+            st;
+        void
+            *p;
+
+        prvInit();
+
+        if ((fd = open(path.c_str(),O_RDWR | O_CREAT,0644)) < 0)
+            prvSystemError("cannot open " + path);
+
+        try {
+            if (fstat(fd,&st) != 0)
+                prvSystemError("cannot stat " + path);
+            fileBytes = st.st_size;
+
+            bool
+                isNew = (fileBytes == 0);
+
+            if (!isNew && fileBytes < POOL_FILE_HEADER_BYTES)
+                throw std::invalid_argument("NodePool: " + path + " is not a pool file");
+            if (isNew)
+                prvGrowFile(POOL_FILE_HEADER_BYTES);
+
+            p = mmap(nullptr,POOL_FILE_HEADER_BYTES,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+            if (p == MAP_FAILED)
+                prvSystemError("cannot map " + path);
+            header = static_cast<PoolFileHeader *>(p);
+
+            if (isNew) {
+                *header = prvFileHeader();
+                header->freeListHead = header->root = NULL_INDEX;
+            } else {
+                PoolFileHeader
+                    expected = prvFileHeader();
+
+                if (header->magic != expected.magic || header->version != expected.version ||
+                    header->layoutTag != expected.layoutTag || header->keyBytes != expected.keyBytes ||
+                    header->valueBytes != expected.valueBytes || header->chunkBytes != expected.chunkBytes)
+                    throw std::invalid_argument("NodePool: " + path + " was not written by a pool of this type");
+
+                if (fileBytes < POOL_FILE_HEADER_BYTES + (uint64_t)(header->capacity >> POOL_CHUNK_BITS) * sizeof(NodeChunk))
+                    throw std::invalid_argument("NodePool: " + path + " is truncated");
+
+                // one mapping covers every chunk already in the file
+                if (header->capacity > 0)
+                    prvMapExtent(header->capacity >> POOL_CHUNK_BITS);
+                reserve(header->capacity);
+
+                freeListHead = header->freeListHead;
+                nextUnused = header->nextUnused;
+                nInUse = header->nInUse;
+            }
+
+            reserve(_cap);
+        } catch (...) {
+            prvRelease();
+            throw;
+        }
+    }
+
+    ~NodePool() { prvRelease(); }
+
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+    // make sure the pool holds at least n nodes in total
+    void reserve(uint32_t n) {
+
+        while (capacity < n)
+            prvAddChunk();
+    }
+
+    bool isFileBacked() { return fd >= 0; }
+
+    // make the file match the pool, recording root as the root of the tree it holds
+    void checkpoint(uint32_t root) {
+
+        if (fd < 0)
+            throw std::logic_error("NodePool: checkpoint of a pool with no file");
+
+        // nodes first, so the header never describes nodes the file lacks
+        for (auto &extent : extents)
+            if (msync(extent.first,extent.second,MS_SYNC) != 0)
+                prvSystemError("cannot flush pool file");
+
+        header->capacity = capacity;
+        header->freeListHead = freeListHead;
+        header->nextUnused = nextUnused;
+        header->nInUse = nInUse;
+        header->nTrees = nTrees;
+        header->root = root;
+
+        if (msync(header,POOL_FILE_HEADER_BYTES,MS_SYNC) != 0)
+            prvSystemError("cannot flush pool file");
+    }
+
+private:
+    friend class RedBlackTree<KeyType,ValueType,Layout>;
+    friend class ConcurrentRedBlackTree<KeyType,ValueType,Layout>;
+
+    typedef typename Layout::template Chunk<KeyType,ValueType> NodeChunk;
+
+    void prvInit() {
+
+        chunks = nullptr;
+        nChunks = dirCapacity = capacity = 0;
+        freeListHead = NULL_INDEX;
+        nextUnused = nInUse = nTrees = 0;
+
+        fd = -1;
+        header = nullptr;
+        fileBytes = 0;
+        extentBase = nullptr;
+        extentFirst = mappedChunks = 0;
+    }
+
+    void prvRelease() {
+
+        if (fd < 0)
+            REPI(i,0,nChunks)
+                delete chunks[i];
+        delete[] chunks;
+
+        for (auto dir : retiredDirs)
+            delete[] dir;
+
+        for (auto &extent : extents)
+            munmap(extent.first,extent.second);
+        if (header != nullptr)
+            munmap(header,POOL_FILE_HEADER_BYTES);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    // the header a file written by this pool type starts with
+    static PoolFileHeader prvFileHeader() {
+        PoolFileHeader
+            h = {};
+
+        h.magic = POOL_FILE_MAGIC;
+        h.version = POOL_FILE_VERSION;
+        h.layoutTag = Layout::TAG;
+        h.keyBytes = sizeof(KeyType);
+        h.valueBytes = sizeof(ValueType);
+        h.chunkBytes = sizeof(NodeChunk);
+
+        return h;
+    }
+
+    [[noreturn]] static void prvSystemError(const std::string &what) {
+
+        throw std::runtime_error("NodePool: " + what + ": " + strerror(errno));
+    }
+
+    void prvGrowFile(uint64_t bytes) {
+
+        if (fileBytes < bytes) {
+            if (ftruncate(fd,bytes) != 0)
+                prvSystemError("cannot grow pool file");
+            fileBytes = bytes;
+        }
+    }
+
+    // map the next n chunks of the file, growing it to hold them. a chunk need not
+    // start on a page boundary, so the mapping starts at the page holding it
+    void prvMapExtent(uint32_t n) {
+        uint64_t
+            page = sysconf(_SC_PAGESIZE),
+            start = POOL_FILE_HEADER_BYTES + (uint64_t)mappedChunks * sizeof(NodeChunk),
+            end = start + (uint64_t)n * sizeof(NodeChunk),
+            mapStart = start & ~(page - 1);
+        void
+            *p;
+
+        prvGrowFile(end);
+
+        p = mmap(nullptr,end - mapStart,PROT_READ | PROT_WRITE,MAP_SHARED,fd,mapStart);
+        if (p == MAP_FAILED)
+            prvSystemError("cannot map pool file");
+        extents.push_back({p,end - mapStart});
+
+        extentBase = static_cast<char *>(p) + (start - mapStart);
+        extentFirst = mappedChunks;
+        mappedChunks += n;
+    }
+
+    // chunk i of a file-backed pool, mapping more of the file if need be
+    NodeChunk *prvMappedChunk(uint32_t i) {
+
+        if (i == mappedChunks)
+            prvMapExtent(std::min(std::max(mappedChunks,POOL_FILE_MIN_EXTENT),
+                                  (COUNT_MASK >> POOL_CHUNK_BITS) - mappedChunks));
+
+        return reinterpret_cast<NodeChunk *>(extentBase + (uint64_t)(i - extentFirst) * sizeof(NodeChunk));
+    }
+
+    uint32_t &left(uint32_t r) { return chunks[r >> POOL_CHUNK_BITS]->left(r & POOL_CHUNK_MASK); }
+    uint32_t &right(uint32_t r) { return chunks[r >> POOL_CHUNK_BITS]->right(r & POOL_CHUNK_MASK); }
+    uint32_t &countAndColor(uint32_t r) {
+
+        return chunks[r >> POOL_CHUNK_BITS]->countAndColor(r & POOL_CHUNK_MASK);
+    }
+    KeyType &keys(uint32_t r) { return chunks[r >> POOL_CHUNK_BITS]->keys(r & POOL_CHUNK_MASK); }
+    ValueType &values(uint32_t r) { return chunks[r >> POOL_CHUNK_BITS]->values(r & POOL_CHUNK_MASK); }
+    void prefetch(uint32_t r) { chunks[r >> POOL_CHUNK_BITS]->prefetch(r & POOL_CHUNK_MASK); }
+
+    void prvAddChunk() {
+
+        // a subtree count must fit in the 31 bits next to the color, which also
+        // keeps the last index clear of NULL_INDEX
+        if (nChunks == (COUNT_MASK >> POOL_CHUNK_BITS))
+            throw std::length_error("NodePool: capacity exhausted");
+
+        // only the chunk directory is ever copied, one pointer per chunk
+        if (nChunks == dirCapacity) {
+            uint32_t
+                newDirCapacity = (dirCapacity == 0) ? 4 : 2 * dirCapacity;
+            auto
+                tmpChunks = new NodeChunk *[newDirCapacity];
+
+            REPI(i,0,nChunks)
+                tmpChunks[i] = chunks[i];
+
+            // a concurrent reader may still be looking at the old directory
+            if (chunks != nullptr)
+                retiredDirs.push_back(chunks);
+
+            __atomic_store_n(&chunks,tmpChunks,__ATOMIC_RELEASE);
+            dirCapacity = newDirCapacity;
+        }
+
+        chunks[nChunks] = (fd < 0) ? new NodeChunk : prvMappedChunk(nChunks);
+        nChunks++;
+        __atomic_store_n(&capacity,capacity + POOL_CHUNK_SIZE,__ATOMIC_RELEASE);
+    }
+
+    // can a concurrent reader safely look at node r? any index below the capacity it
+    // sees lies in a chunk reachable from the directory it will see
+    bool readerCanSee(uint32_t r) { return r < __atomic_load_n(&capacity,__ATOMIC_ACQUIRE); }
+
+    uint32_t allocate() {
+        uint32_t
+            tmp;
+
+        if (freeListHead != NULL_INDEX) {
+            tmp = freeListHead;
+            freeListHead = left(freeListHead);
+        } else {
+            if (nextUnused == capacity)
+                prvAddChunk();
+            tmp = nextUnused++;
+        }
+
+        nInUse++;
+
+        left(tmp) = right(tmp) = NULL_INDEX;
+        countAndColor(tmp) = COLOR_BIT | 1;     // red, count 1
+
+        return tmp;
+    }
+
+    // hand out n consecutive indices from the untouched end of the pool, growing it as
+    // needed; the caller fills in every field. returns the first index of the run
+    uint32_t allocateRun(uint32_t n) {
+        uint32_t
+            base = nextUnused;
+
+        if (n > NULL_INDEX - base)
+            throw std::length_error("NodePool: capacity exhausted");
+
+        reserve(base + n);
+
+        nextUnused += n;
+        nInUse += n;
+
+        return base;
+    }
+
+    void release(uint32_t r) {
+
+        if constexpr (HOLDS_RESOURCES) {
+            keys(r) = KeyType();
+            values(r) = ValueType();
+        }
+
+        left(r) = freeListHead;
+        freeListHead = r;
+
+        nInUse--;
+    }
+
+    // forget every node at once; only safe when no tree still refers to the pool's nodes,
+    // and only right when they hold no resources, as nothing is reset
+    void reset() {
+
+        freeListHead = NULL_INDEX;
+        nextUnused = nInUse = 0;
+    }
+
+    NodeChunk
+        **chunks;
+
+    std::vector<NodeChunk **>
+        retiredDirs;
+
+    uint32_t
+        nChunks,
+        dirCapacity,
+        capacity,
+        freeListHead,
+        nextUnused,
+        nInUse,
+        nTrees;
+
+    //
+    // file-backed pools only
+    //
+
+    int
+        fd;                     // -1 for a pool on the heap
+
+    PoolFileHeader
+        *header;
 
-template <typename KeyType,typename ValueType>
+    std::vector<std::pair<void *,size_t>>
+        extents;                // every mapping of the file's chunks
+
+    char
+        *extentBase;            // where chunk extentFirst starts in the newest mapping
+
+    uint64_t
+        fileBytes;
+
+    uint32_t
+        extentFirst,
+        mappedChunks;           // chunks the mappings cover, used or not
+};
+
+enum PoolMode {
+    SHARED_POOL,                // one pool for every tree of the instantiation
+    PRIVATE_POOL                // pool owned by, and freed with, this tree
+};
+
+template <typename KeyType,typename ValueType,typename Layout=SoALayout>
 class RedBlackTree {
 public:
-    explicit RedBlackTree(uint32_t _cap=DEFAULT_INIT_CAPACITY) {
+    //
+    // Iterator
+    //      bidirectional, in key order. dereferencing gives the value; key() gives the
+    //      key. the iterator carries the path from the root to its node, so stepping
+    //      needs neither recursion nor parent links: O(1) amortized per step. any update
+    //      to the tree invalidates it
+    //
 
-        if (nTrees == 0) {
-            left = new uint32_t[_cap];
-            right = new uint32_t[_cap];
-            counts = new uint32_t[_cap];
-            heights = new uint32_t[_cap];
+    class Iterator {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef ValueType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef ValueType *pointer;
+        typedef ValueType &reference;
 
-            colors = new uint8_t[_cap];
+        Iterator() { tree = nullptr; depth = 0; }
 
-            keys = new KeyType[_cap];
-            values = new ValueType[_cap];
+        const KeyType &key() const { return tree->keys(path[depth-1]); }
 
-            capacity = _cap;
+        ValueType &value() const { return tree->values(path[depth-1]); }
 
-            REPI(i,0,capacity-1)
-                left[i] = i + 1;
-            left[capacity-1] = NULL_INDEX;
+        ValueType &operator*() const { return value(); }
 
-            freeListHead = 0;
+        ValueType *operator->() const { return &value(); }
+
+        // handle of the element the iterator is on; see findHandle()
+        uint32_t handle() const { return node(); }
+
+        Iterator &operator++() {
+            uint32_t
+                r = path[depth-1];
+
+            if (tree->right(r) != NULL_INDEX) {
+                // leftmost node of the right subtree
+                path[depth++] = r = tree->right(r);
+                while (tree->left(r) != NULL_INDEX)
+                    path[depth++] = r = tree->left(r);
+            } else
+                // climb until we leave a left subtree
+                do
+                    r = path[--depth];
+                while (depth > 0 && tree->right(path[depth-1]) == r);
+
+            return *this;
         }
 
-        nTrees++;
+        Iterator &operator--() {
+            uint32_t
+                r;
+
+            if (depth == 0) {
+                // stepping back from end() lands on the largest key
+                if ((r = tree->root) != NULL_INDEX) {
+                    path[depth++] = r;
+                    while (tree->right(r) != NULL_INDEX)
+                        path[depth++] = r = tree->right(r);
+                }
+            } else if (tree->left(r = path[depth-1]) != NULL_INDEX) {
+                // rightmost node of the left subtree
+                path[depth++] = r = tree->left(r);
+                while (tree->right(r) != NULL_INDEX)
+                    path[depth++] = r = tree->right(r);
+            } else
+                // climb until we leave a right subtree
+                do
+                    r = path[--depth];
+                while (depth > 0 && tree->left(path[depth-1]) == r);
+
+            return *this;
+        }
+
+        Iterator operator++(int) { Iterator tmp = *this; ++*this; return tmp; }
+
+        Iterator operator--(int) { Iterator tmp = *this; --*this; return tmp; }
+
+        bool operator==(const Iterator &other) const { return node() == other.node(); }
+
+        bool operator!=(const Iterator &other) const { return node() != other.node(); }
+
+    private:
+        friend class RedBlackTree;
+
+        explicit Iterator(RedBlackTree *_tree) { tree = _tree; depth = 0; }
+
+        uint32_t node() const { return (depth == 0) ? NULL_INDEX : path[depth-1]; }
+
+        RedBlackTree
+            *tree;
+        uint32_t
+            path[RB_MAX_DEPTH],
+            depth;
+    };
+
+    // a pair of iterators usable in a range-based for
+    struct Range {
+        Iterator
+            first,
+            last;
+
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+    };
+
+    explicit RedBlackTree(uint32_t _cap=DEFAULT_INIT_CAPACITY,PoolMode mode=SHARED_POOL) {
+
+        if (mode == PRIVATE_POOL)
+            pool = new NodePool<KeyType,ValueType,Layout>(_cap);
+        else {
+            if (sharedPool == nullptr)
+                sharedPool = new NodePool<KeyType,ValueType,Layout>(_cap);
+            pool = sharedPool;
+        }
+
+        ownsPool = true;
+
+        pool->nTrees++;
 
         root = NULL_INDEX;
     }
 
+    explicit RedBlackTree(NodePool<KeyType,ValueType,Layout> &arena) {
+
+        pool = &arena;
+        ownsPool = false;
+
+        pool->nTrees++;
+
+        root = NULL_INDEX;
+    }
+
+    // a tree kept in the file at path, in a pool of its own (see NodePool): reopened as
+    // it was at its last checkpoint if the file exists, created empty otherwise. the
+    // nodes are used where they lie in the mapped file, so reopening takes the same
+    // time whatever the size of the tree; pages are read in as searches touch them
+    explicit RedBlackTree(const std::string &path,uint32_t _cap=DEFAULT_INIT_CAPACITY) {
+
+        pool = new NodePool<KeyType,ValueType,Layout>(path,_cap);
+        ownsPool = true;
+
+        root = pool->header->root;
+
+        pool->nTrees++;
+    }
+
+    RedBlackTree(const RedBlackTree &) = delete;
+    RedBlackTree &operator=(const RedBlackTree &) = delete;
+
+    friend class ConcurrentRedBlackTree<KeyType,ValueType,Layout>;
+
     ~RedBlackTree() {
 
-        nTrees--;
+        // a tree in a file is checkpointed on the way out; there is no one left to
+        // tell if that fails
+        if (ownsPool && pool->isFileBacked())
+            try {
+                checkpoint();
+            } catch (const std::exception &) {
+            }
+
+        pool->nTrees--;
 
-        if (nTrees == 0) {
-            delete[] values;
-            delete[] keys;
-            delete[] colors;
-            delete[] heights;
-            delete[] counts;
-            delete[] right;
-            delete[] left;
+        if (ownsPool && pool->nTrees == 0) {
+            if (pool == sharedPool)
+                sharedPool = nullptr;
+            delete pool;
         } else
             prvClear(root);
     }
 
-    void clear() { prvClear(root); root = NULL_INDEX; }
+    void clear() {
+
+        // sole user of the pool? then every node in it is ours; drop them all at once,
+        // unless each pair has to let go of what it holds
+        if (pool->nTrees == 1 && !NodePool<KeyType,ValueType,Layout>::HOLDS_RESOURCES)
+            pool->reset();
+        else
+            prvClear(root);
+
+        root = NULL_INDEX;
+    }
+
+    // flush a tree kept in a file, so that reopening the file gives the tree as it is
+    // now; throws logic_error if the tree's pool has no file
+    void checkpoint() { pool->checkpoint(root); }
+
+    // make room for this tree to hold n keys without growing the pool
+    void reserve(uint32_t n) {
+
+        if (n > size())
+            pool->reserve(pool->nInUse + (n - size()));
+    }
 
     uint32_t size() { return GET_COUNT(root); }
 
-    uint32_t height() { return GET_HEIGHT(root); }
+    // nodes on the longest root-to-leaf path. heights are not stored, so this walks
+    // the whole tree: O(n)
+    uint32_t height() {
+        std::vector<std::pair<uint32_t,uint32_t>>
+            stack;
+        uint32_t
+            h = 0;
+
+        if (root != NULL_INDEX)
+            stack.push_back({root,1});
+
+        while (!stack.empty()) {
+            auto
+                top = stack.back();
+
+            stack.pop_back();
+            h = std::max(h,top.second);
+
+            if (left(top.first) != NULL_INDEX)
+                stack.push_back({left(top.first),top.second + 1});
+            if (right(top.first) != NULL_INDEX)
+                stack.push_back({right(top.first),top.second + 1});
+        }
+
+        return h;
+    }
 
     bool isEmpty() { return root == NULL_INDEX; }
 
     ValueType &search(const KeyType &k) {
 
         for (uint32_t r=root;r!=NULL_INDEX;) {
-            if (k == keys[r])
-                return values[r];
-            if (k < keys[r])
-                r = left[r];
+            if (k == keys(r))
+                return values(r);
+            if (k < keys(r))
+                r = left(r);
             else
-                r = right[r];
+                r = right(r);
         }
 
         throw std::domain_error("Search: Key not found");
     }
 
+    //
+    // order statistics, all O(log n) using the subtree counts
+    //
+
+    // position of k in sorted order
+    uint32_t rank(const KeyType &k) {
+        uint32_t
+            pos = 0;
+
+        for (uint32_t r=root;r!=NULL_INDEX;) {
+            if (k == keys(r))
+                return pos + GET_COUNT(left(r));
+            if (k < keys(r))
+                r = left(r);
+            else {
+                pos += GET_COUNT(left(r)) + 1;
+                r = right(r);
+            }
+        }
+
+        throw std::domain_error("Rank: Key not found");
+    }
+
+    // key at position i in sorted order
+    const KeyType &select(uint32_t i) {
+        uint32_t
+            r = root,
+            lc;
+
+        if (i >= size())
+            throw std::out_of_range("Select: Index " + std::to_string(i) + " is out of range");
+
+        while (true) {
+            lc = GET_COUNT(left(r));
+            if (i == lc)
+                return keys(r);
+            if (i < lc)
+                r = left(r);
+            else {
+                i -= lc + 1;
+                r = right(r);
+            }
+        }
+    }
+
+    // number of keys less than k; k need not be in the tree
+    uint32_t countLess(const KeyType &k) { return prvCountBelow(k,false); }
+
+    // number of keys in [lo,hi]
+    uint32_t countRange(const KeyType &lo,const KeyType &hi) {
+
+        if (hi < lo)
+            return 0;
+
+        return prvCountBelow(hi,true) - prvCountBelow(lo,false);
+    }
+
+    Iterator begin() {
+        Iterator
+            it(this);
+
+        for (uint32_t r=root;r!=NULL_INDEX;r=left(r))
+            it.path[it.depth++] = r;
+
+        return it;
+    }
+
+    Iterator end() { return Iterator(this); }
+
+    // first key not less than k
+    Iterator lower_bound(const KeyType &k) { return prvBound(k,false); }
+
+    // first key greater than k
+    Iterator upper_bound(const KeyType &k) { return prvBound(k,true); }
+
+    // keys in [lo,hi], in order; O(log n + number of keys visited)
+    Range range(const KeyType &lo,const KeyType &hi) {
+
+        if (hi < lo)
+            return Range{end(),end()};
+
+        return Range{lower_bound(lo),upper_bound(hi)};
+    }
+
+    //
+    // keys and values passed as rvalues are moved into the tree rather than copied. a
+    // key is only moved from if it turns out to be new
+    //
+
     ValueType &operator[](const KeyType &k) {
+        bool
+            isNew;
 
-        root = prvInsert(root,k);
+        return values(prvUpsert(k,isNew));
+    }
 
-        colors[root] = NODE_BLACK;
+    ValueType &operator[](KeyType &&k) {
+        bool
+            isNew;
+
+        return values(prvUpsert(std::move(k),isNew));
+    }
+
+    // insert k with value v unless k is already present; true if k was new
+    bool tryInsert(const KeyType &k,const ValueType &v) { return emplace(k,v); }
+    bool tryInsert(KeyType &&k,ValueType &&v) { return emplace(std::move(k),std::move(v)); }
+
+    // insert k with the value built from args unless k is already present, in which
+    // case args are left untouched; true if k was new
+    template <typename... Args>
+    bool emplace(const KeyType &k,Args &&...args) { return prvEmplace(k,std::forward<Args>(args)...); }
+
+    template <typename... Args>
+    bool emplace(KeyType &&k,Args &&...args) {
+
+        return prvEmplace(std::move(k),std::forward<Args>(args)...);
+    }
+
+    // set the value for k, inserting k if needed; true if k was new
+    template <typename V>
+    bool insertOrAssign(const KeyType &k,V &&v) { return prvAssign(k,std::forward<V>(v)); }
+
+    template <typename V>
+    bool insertOrAssign(KeyType &&k,V &&v) { return prvAssign(std::move(k),std::forward<V>(v)); }
+
+    //
+    // handles. an element's handle is the index of its node in the pool. nodes never
+    // move -- pool growth adds chunks without relocating any, and removal,
+    // insertBatch(), split(), join() and the set operations relink nodes rather than
+    // moving contents -- so a handle, like a reference from operator[] or valueAt(),
+    // stays valid whatever else is inserted or removed meanwhile. it is invalidated
+    // only when its own element is removed (by remove(), erase() or a set operation
+    // that drops it) or the whole tree is replaced: clear(), buildFromSorted(),
+    // buildFromUnsorted() and loadFrom() all give up every node. using a handle
+    // after that is undefined, as with a dangling pointer
+    //
+
+    // handle of k, or NULL_INDEX if k is not in the tree; O(log n)
+    uint32_t findHandle(const KeyType &k) {
 
         for (uint32_t r=root;r!=NULL_INDEX;) {
-            if (k == keys[r])
-                return values[r];
-            if (k < keys[r])
-                r = left[r];
-            else
-                r = right[r];
+            if (k == keys(r))
+                return r;
+            r = (k < keys(r)) ? left(r) : right(r);
         }
 
-        throw std::domain_error("Search: Key not found");
+        return NULL_INDEX;
     }
 
-    void map(void (*fp)(const KeyType &,ValueType &)) {
+    // outHandles[i] = findHandle(ks[i]) for each of the n keys. a lone search stalls at
+    // every level until the next node arrives from memory; here GROUP searches are in
+    // flight at once, stepping in turn, and each prefetches the node it will look at
+    // next, so their cache misses overlap. a search that finishes hands its place to
+    // the next key
+    template <uint32_t GROUP=SEARCH_BATCH_GROUP>
+    void searchBatch(const KeyType *ks,uint32_t *outHandles,uint32_t n) {
+        uint32_t
+            at[GROUP],                  // node each search is about to look at
+            which[GROUP],               // the key it is looking for
+            nActive = std::min(n,GROUP),
+            next = nActive;
+
+        REPI(g,0,nActive) {
+            at[g] = root;
+            which[g] = g;
+        }
 
-        prvMap(root,fp);
+        while (nActive > 0)
+            for (uint32_t g=0;g<nActive;) {
+                uint32_t
+                    r = at[g];
+                const KeyType
+                    &k = ks[which[g]];
+
+                if (r != NULL_INDEX && !(k == keys(r))) {
+                    r = (k < keys(r)) ? left(r) : right(r);
+                    if (r != NULL_INDEX)
+                        pool->prefetch(r);
+                    at[g++] = r;
+                    continue;
+                }
+
+                outHandles[which[g]] = r;
+
+                if (next < n) {
+                    at[g] = root;
+                    which[g++] = next++;
+                } else {
+                    // retire this place; the last one moves in and steps next
+                    nActive--;
+                    at[g] = at[nActive];
+                    which[g] = which[nActive];
+                }
+            }
+    }
+
+    // handle of k, inserting k with a default value first if needed; O(log n)
+    uint32_t insertHandle(const KeyType &k) {
+        bool
+            isNew;
+
+        return prvUpsert(k,isNew);
+    }
+
+    uint32_t insertHandle(KeyType &&k) {
+        bool
+            isNew;
+
+        return prvUpsert(std::move(k),isNew);
+    }
+
+    // the element behind a handle; O(1)
+    ValueType &valueAt(uint32_t h) { return values(h); }
+    const KeyType &keyAt(uint32_t h) { return keys(h); }
+
+    // remove the element behind a handle. the LLRB removal restructures the whole
+    // path from the root, so this is the same O(log n) descent as remove(keyAt(h));
+    // what the handle saves is having the key at hand
+    void erase(uint32_t h) { remove(keys(h)); }
+
+    //
+    // visit every pair in key order. visit can be any callable taking
+    // (const KeyType &,ValueType &) -- a function pointer or a lambda with captures --
+    // and is called directly, so it can be inlined. the walk keeps its own stack
+    //
+
+    template <typename Visitor>
+    void map(Visitor &&visit) {
+
+        mapWhile([&visit](const KeyType &k,ValueType &v) { visit(k,v); return true; });
+    }
+
+    // as map(), but stop as soon as visit returns false; true if every pair was visited
+    template <typename Visitor>
+    bool mapWhile(Visitor &&visit) {
+        uint32_t
+            stack[RB_MAX_DEPTH],
+            depth = 0,
+            r = root;
+
+        while (r != NULL_INDEX || depth > 0) {
+            for (;r!=NULL_INDEX;r=left(r))
+                stack[depth++] = r;
+
+            r = stack[--depth];
+
+            if (!visit(keys(r),values(r)))
+                return false;
+
+            r = right(r);
+        }
+
+        return true;
+    }
+
+    // a read-only snapshot of the tree, laid out for fast search, rank and select; see
+    // frozenTree.h. O(n)
+    FrozenTree<KeyType,ValueType> freeze() {
+
+        return FrozenTree<KeyType,ValueType>(size(),[this](auto &&emit) { map(emit); });
+    }
+
+    //
+    // insert or assign n pairs at once; if a key repeats, its last value wins, just as
+    // with a loop over operator[]. the batch is sorted first. a batch that is small next
+    // to the tree is then inserted in key order, so consecutive descents share their
+    // upper path in cache; a larger one is merged with the tree's nodes and the tree
+    // relinked in O(size + n). either way the pairs already in the tree stay in their
+    // nodes -- nothing is copied out and back -- and only new keys get nodes
+    //
+
+    void insertBatch(const KeyType *ks,const ValueType *vs,uint32_t n) {
+        std::vector<uint32_t>
+            order(n);
+        uint32_t
+            nUnique = 0;
+
+        REPI(i,0,n)
+            order[i] = i;
+
+        std::stable_sort(order.begin(),order.end(),
+                         [ks](uint32_t a,uint32_t b) { return ks[a] < ks[b]; });
+
+        // keep the last of each run of equal keys
+        REPI(i,0,n)
+            if (i + 1 == n || ks[order[i]] < ks[order[i+1]])
+                order[nUnique++] = order[i];
+
+        if ((uint64_t)nUnique * BATCH_REBUILD_RATIO < size()) {
+            bool
+                isNew;
+
+            REPI(i,0,nUnique)
+                values(prvUpsert(ks[order[i]],isNew)) = vs[order[i]];
+        } else {
+            uint32_t
+                stack[RB_MAX_DEPTH],
+                depth = 0,
+                r = root,
+                nOld = size(),
+                i = 0,
+                j = 0;
+            std::vector<uint32_t>
+                oldNodes,
+                merged;
+
+            oldNodes.reserve(nOld);
+            merged.reserve(nOld + nUnique);
+
+            while (r != NULL_INDEX || depth > 0) {
+                for (;r!=NULL_INDEX;r=left(r))
+                    stack[depth++] = r;
+
+                r = stack[--depth];
+                oldNodes.push_back(r);
+                r = right(r);
+            }
+
+            // standard merge of nodes; on a tie the batch value goes into the old node
+            while (i < nOld || j < nUnique) {
+                if (j == nUnique || (i < nOld && keys(oldNodes[i]) < ks[order[j]])) {
+                    merged.push_back(oldNodes[i++]);
+                    continue;
+                }
+
+                if (i < nOld && !(ks[order[j]] < keys(oldNodes[i])))
+                    r = oldNodes[i++];
+                else {
+                    r = prvAllocate();
+                    keys(r) = ks[order[j]];
+                }
+                values(r) = vs[order[j++]];
+                merged.push_back(r);
+            }
+
+            prvRelink(merged);
+        }
+    }
+
+    //
+    // replace the contents of the tree with the n pairs in ks/vs, which must be in
+    // strictly increasing key order. runs in O(n): the result is a 2-3 tree with every
+    // leaf at depth floor(lg(n+1)). when the pool has no free nodes to recycle (always
+    // the case for a tree that is its pool's only user) the nodes are one run of
+    // consecutive indices laid out so that key order is index order.
+    //
+    // with nThreads above one, the nodes are always one such run, and the subtrees of
+    // the top levels are built on threads of their own, each over its own stretch of
+    // the run; nodes the pool had free stay on its free list
+    //
+
+    void buildFromSorted(const KeyType *ks,const ValueType *vs,uint32_t n,uint32_t nThreads=1) {
+        uint32_t
+            nSlices = parallelSliceCount(n,nThreads);
+        std::vector<char>
+            sorted(nSlices,true);
+
+        parallelSlices(n,nSlices,[&](uint32_t t,uint32_t lo,uint32_t hi) {
+            uint32_t
+                j = std::max<uint32_t>(lo,1);
+
+            while (j < hi && ks[j-1] < ks[j])
+                j++;
+            sorted[t] = j >= hi;
+        });
+        if (std::find(sorted.begin(),sorted.end(),false) != sorted.end())
+            throw std::invalid_argument("buildFromSorted: keys not strictly increasing");
+
+        prvBuildFrom(n,[&](uint32_t r,uint32_t p) {
+            keys(r) = ks[p];
+            values(r) = vs[p];
+        },nThreads);
+    }
+
+    //
+    // replace the contents of the tree with the n pairs in ks/vs, in any order; if a
+    // key repeats, its last value wins, just as with a loop over operator[]. the pairs
+    // are sorted by parallelSortPairs() (see parallelSort.h) -- a radix sort for
+    // integer keys -- and the tree built as by buildFromSorted(), each on up to
+    // nThreads threads
+    //
+
+    void buildFromUnsorted(const KeyType *ks,const ValueType *vs,uint32_t n,
+                           uint32_t nThreads=std::thread::hardware_concurrency()) {
+        uint32_t
+            nSlices = parallelSliceCount(n,nThreads),
+            nUnique;
+        std::vector<KeyType>
+            sorted(n);
+        std::vector<ValueType>
+            sortedValues(n);
+        std::vector<uint32_t>
+            firstKept(nSlices + 1,0),
+            kept;
+
+        parallelSortPairs(ks,vs,n,sorted.data(),sortedValues.data(),nThreads);
+
+        // keep the last of each run of equal keys: count them slice by slice, then
+        // list where they are
+        auto isKept = [&](uint32_t i) { return i + 1 == n || sorted[i] < sorted[i+1]; };
+
+        parallelSlices(n,nSlices,[&](uint32_t t,uint32_t lo,uint32_t hi) {
+            uint32_t
+                count = 0;
+
+            for (uint32_t i=lo;i<hi;i++)
+                count += isKept(i);
+            firstKept[t+1] = count;
+        });
+        REPI(t,0,nSlices)
+            firstKept[t+1] += firstKept[t];
+        nUnique = firstKept[nSlices];
+
+        if (nUnique < n) {
+            kept.resize(nUnique);
+            parallelSlices(n,nSlices,[&](uint32_t t,uint32_t lo,uint32_t hi) {
+                uint32_t
+                    j = firstKept[t];
+
+                for (uint32_t i=lo;i<hi;i++)
+                    if (isKept(i))
+                        kept[j++] = i;
+            });
+        }
+
+        prvBuildFrom(nUnique,[&](uint32_t r,uint32_t p) {
+            uint32_t
+                i = (nUnique < n) ? kept[p] : p;
+
+            keys(r) = sorted[i];
+            values(r) = sortedValues[i];
+        },nThreads);
+    }
+
+    //
+    // snapshots (see snapshot.h). keys and values must be trivially copyable
+    //
+
+    // write the pairs to os in key order. delta encoding, the default for integer keys,
+    // stores each key as its distance from the one before
+    void saveTo(std::ostream &os,bool delta=snapshotCanDelta<KeyType>()) {
+        SnapshotWriter<KeyType>
+            out(os,delta,sizeof(ValueType),size());
+
+        map([&out](const KeyType &k,ValueType &v) {
+            out.putKey(k);
+            out.putValue(v);
+        });
+
+        out.finish();
+    }
+
+    // replace the contents of the tree with a snapshot read from is, building the tree
+    // as the pairs arrive, as buildFromSorted() does: O(n) time and O(log n) space
+    // beyond the tree. a stream that cannot seek can't vouch for the count in its
+    // header, so its pairs are read into a buffer first and the tree is sized by how
+    // many turn up. if the header is bad, or promises more pairs than a seekable stream
+    // holds, the tree is left alone; if the pairs are bad it is left empty. either way
+    // invalid_argument is thrown
+    void loadFrom(std::istream &is) {
+        SnapshotReader<KeyType>
+            in(is,sizeof(ValueType),true);
+
+        if (in.size() > COUNT_MASK)
+            throw std::length_error("loadFrom: snapshot too large for a tree");
+
+        if (in.sizeChecked())
+            prvBuildFrom(in.size(),[&in,this](uint32_t r,uint32_t) {
+                in.getKey(keys(r));
+                in.getValue(values(r));
+            });
+        else {
+            std::vector<KeyType>
+                ks;
+            std::vector<ValueType>
+                vs;
+            KeyType
+                k;
+            ValueType
+                v;
+
+            while (ks.size() < in.size()) {
+                in.getKey(k);
+                in.getValue(v);
+                if (in.failed())
+                    break;
+                ks.push_back(k);
+                vs.push_back(v);
+            }
+
+            if (!in.failed())
+                prvBuildFrom(ks.size(),[&ks,&vs,this](uint32_t r,uint32_t p) {
+                    keys(r) = ks[p];
+                    values(r) = vs[p];
+                });
+        }
+
+        try {
+            in.finish();
+        } catch (const std::invalid_argument &) {
+            clear();
+            throw;
+        }
     }
 
     void remove(const KeyType &k) {
         uint32_t
             ntbd;
 
-        try {
-            search(k);
-        } catch (const std::domain_error &e) {
+        if (root == NULL_INDEX)
             throw std::domain_error("Remove: Key not found");
-        }
 
-        if (!IS_RED(left[root]) && !IS_RED(right[root]))
-            colors[root] = NODE_RED;
+        if (!IS_RED(left(root)) && !IS_RED(right(root)))
+            setColor(root,NODE_RED);
 
         root = prvRemove(root,ntbd,k);
 
+        if (root != NULL_INDEX)
+            setColor(root,NODE_BLACK);
+
+        if (ntbd == NULL_INDEX)
+            throw std::domain_error("Remove: Key not found");
+
         prvFree(ntbd);
+    }
 
-        if (root != NULL_INDEX)
-            colors[root] = NODE_BLACK;
+    //
+    // split and join
+    //      both relink nodes between trees instead of copying them, so they take
+    //      O(log n) whatever the number of keys that move, and handles stay valid.
+    //      the trees involved must share a pool -- the shared pool or an arena --
+    //      or invalid_argument is thrown
+    //
+
+    // move the keys less than k into less and the rest into ge, leaving this tree
+    // empty. less and ge are cleared first; either of them may be this tree
+    void split(const KeyType &k,RedBlackTree &less,RedBlackTree &ge) {
+        uint32_t
+            r = root,
+            h,
+            hLess,
+            hGe;
+
+        if (less.pool != pool || ge.pool != pool)
+            throw std::invalid_argument("split: trees do not share a pool");
+        if (&less == &ge)
+            throw std::invalid_argument("split: less and ge are the same tree");
+
+        h = prvBlackHeight(r);
+        root = NULL_INDEX;
+        less.clear();
+        ge.clear();
+
+        prvSplit(r,h,k,less.root,hLess,ge.root,hGe);
+
+        if (less.root != NULL_INDEX)
+            setColor(less.root,NODE_BLACK);
+        if (ge.root != NULL_INDEX)
+            setColor(ge.root,NODE_BLACK);
+    }
+
+    // move every key of greater, each of which must be greater than every key of this
+    // tree, into this tree, leaving greater empty
+    void join(RedBlackTree &greater) {
+        uint32_t
+            g = greater.root,
+            h;
+
+        if (greater.pool != pool)
+            throw std::invalid_argument("join: trees do not share a pool");
+        if (&greater == this)
+            throw std::invalid_argument("join: a tree cannot join itself");
+
+        if (g == NULL_INDEX)
+            return;
+
+        if (root != NULL_INDEX && !(prvMaxKey(root) < prvMinKey(g)))
+            throw std::invalid_argument("join: keys overlap");
+
+        greater.root = NULL_INDEX;
+
+        // the smallest node of greater goes between the two trees
+        root = prvConcat(root,prvBlackHeight(root),g,h);
+        setColor(root,NODE_BLACK);
+    }
+
+    //
+    // set operations
+    //      combine other into this tree with joins, in O(m log(n/m + 1)) work for trees
+    //      of m <= n keys, running the two halves of every large enough piece of the
+    //      work on separate threads, up to nThreads at once. like split() and join(),
+    //      they relink nodes rather than copy them, so other must share this tree's
+    //      pool (or invalid_argument is thrown); other is left empty, and the nodes
+    //      neither tree keeps are freed once the threads are done. where unite() or
+    //      intersect() finds a key in both trees, other's value is moved into this
+    //      tree's node and other's node is freed, so other's value wins while handles
+    //      into this tree stay valid. handles into other follow the nodes that move
+    //      across; those for keys other loses are invalidated
+    //
+
+    // keep the keys in either tree
+    void unite(RedBlackTree &other,uint32_t nThreads=std::thread::hardware_concurrency()) {
+
+        prvCombine(SET_UNION,other,nThreads,"unite");
+    }
+
+    // keep the keys in both trees
+    void intersect(RedBlackTree &other,uint32_t nThreads=std::thread::hardware_concurrency()) {
+
+        prvCombine(SET_INTERSECTION,other,nThreads,"intersect");
+    }
+
+    // keep the keys of this tree that are not in other
+    void subtract(RedBlackTree &other,uint32_t nThreads=std::thread::hardware_concurrency()) {
+
+        prvCombine(SET_DIFFERENCE,other,nThreads,"subtract");
     }
 
     void isValidRBTree() {
@@ -144,122 +1457,241 @@ public:
 
         prvIsValid(root,leafDepth,0);
 
-        if (GET_HEIGHT(root) > 2 * ceil(log2(GET_COUNT(root)+1)))
+        if (height() > 2 * ceil(log2(GET_COUNT(root)+1)))
             throw std::logic_error("tree too tall");
     }
 
 private:
-    uint32_t prvAllocate() {
+    uint32_t &left(uint32_t r) { return pool->left(r); }
+    uint32_t &right(uint32_t r) { return pool->right(r); }
+    uint32_t counts(uint32_t r) { return pool->countAndColor(r) & COUNT_MASK; }
+    uint32_t colors(uint32_t r) { return pool->countAndColor(r) >> 31; }
 
-        if (freeListHead == NULL_INDEX) {
-            auto
-                tmpLeft = new uint32_t[2*capacity];
-            auto
-                tmpRight = new uint32_t[2*capacity];
-            auto
-                tmpCounts = new uint32_t[2*capacity];
-            auto
-                tmpHeights = new uint32_t[2*capacity];
-            auto
-                tmpColors = new uint8_t[2*capacity];
-            auto
-                tmpKeys = new KeyType[2*capacity];
-            auto
-                tmpValues = new ValueType[2*capacity];
-
-            REPI(i,0,capacity) {
-                tmpLeft[i] = left[i];
-                tmpRight[i] = right[i];
-                tmpCounts[i] = counts[i];
-                tmpHeights[i] = heights[i];
-                tmpColors[i] = colors[i];
-                tmpKeys[i] = keys[i];
-                tmpValues[i] = values[i];
-            }
+    void setCount(uint32_t r,uint32_t n) {
+        uint32_t
+            &word = pool->countAndColor(r);
 
-            delete[] values;
-            delete[] keys;
-            delete[] colors;
-            delete[] heights;
-            delete[] counts;
-            delete[] right;
-            delete[] left;
+        word = (word & COLOR_BIT) | n;
+    }
 
-            left = tmpLeft;
-            right = tmpRight;
-            counts = tmpCounts;
-            heights = tmpHeights;
-            colors = tmpColors;
-            keys = tmpKeys;
-            values = tmpValues;
+    void setColor(uint32_t r,uint32_t color) {
+        uint32_t
+            &word = pool->countAndColor(r);
 
-            REPI(i,capacity,2*capacity-1)
-                left[i] = i + 1;
-            left[2*capacity-1] = NULL_INDEX;
+        word = (word & COUNT_MASK) | (color << 31);
+    }
+    KeyType &keys(uint32_t r) { return pool->keys(r); }
+    ValueType &values(uint32_t r) { return pool->values(r); }
 
-            freeListHead = capacity;
-
-            capacity *= 2;
-        }
+    uint32_t prvAllocate() { return pool->allocate(); }
 
+    // first key greater than k if strict, else first key not less than k
+    Iterator prvBound(const KeyType &k,bool strict) {
+        Iterator
+            it(this);
         uint32_t
-            tmp = freeListHead;
+            found = 0;
 
-        freeListHead = left[freeListHead];
+        // the path to the last node we turned left at is the path to the answer
+        for (uint32_t r=root;r!=NULL_INDEX;) {
+            it.path[it.depth++] = r;
+            if (k < keys(r) || (!strict && k == keys(r))) {
+                found = it.depth;
+                r = left(r);
+            } else
+                r = right(r);
+        }
 
-        left[tmp] = right[tmp] = NULL_INDEX;
-        counts[tmp] = heights[tmp] = 1;
-        colors[tmp] = NODE_RED;
+        it.depth = found;
 
-        return tmp;
+        return it;
     }
-    void prvFree(uint32_t r) {
 
-        left[r] = freeListHead;
-        freeListHead = r;
+    // number of keys less than k, or no greater than k if inclusive
+    uint32_t prvCountBelow(const KeyType &k,bool inclusive) {
+        uint32_t
+            count = 0;
+
+        for (uint32_t r=root;r!=NULL_INDEX;)
+            if (k < keys(r) || (!inclusive && k == keys(r)))
+                r = left(r);
+            else {
+                count += GET_COUNT(left(r)) + 1;
+                r = right(r);
+            }
+
+        return count;
     }
 
+    void prvFree(uint32_t r) { pool->release(r); }
+
     void prvClear(uint32_t r) {
 
         if (r != NULL_INDEX) {
-            prvClear(left[r]);
-            prvClear(right[r]);
+            prvClear(left(r));
+            prvClear(right(r));
 
             prvFree(r);
         }
     }
 
-    void prvMap(uint32_t r,void (*fp)(const KeyType &,ValueType &)) {
+    // replace the contents of the tree with n pairs from fill(r,p), which stores the
+    // pair at sorted position p in node r. on one thread the calls come in key order,
+    // so fill can ignore p and read a stream; on more they come in any order, from
+    // several threads at once
+    template <typename Fill>
+    void prvBuildFrom(uint32_t n,Fill &&fill,uint32_t nThreads=1) {
+        uint32_t
+            base,
+            forks = prvForkLevels(nThreads);
 
-        if (r != NULL_INDEX) {
-            prvMap(left[r],fp);
+        clear();
+
+        if (n == 0)
+            return;
 
-            (*fp)(keys[r],values[r]);
+        // only a run of nodes can be handed out to several threads
+        base = (forks > 0 || pool->freeListHead == NULL_INDEX) ? pool->allocateRun(n) : NULL_INDEX;
 
-            prvMap(right[r],fp);
+        auto pick = [this,base](uint32_t p) { return (base == NULL_INDEX) ? prvAllocate() : base + p; };
+
+        root = prvBuild(fill,pick,0,n,prvBlackLevels(n),forks);
+    }
+
+    // rebuild the tree over nodes that already hold its pairs, listed in key order.
+    // only links, counts and colors are rewritten, so no pair is copied and every
+    // node keeps its index. O(n)
+    void prvRelink(const std::vector<uint32_t> &inOrder) {
+        auto fill = [](uint32_t,uint32_t) {};
+        auto pick = [&inOrder](uint32_t p) { return inOrder[p]; };
+
+        root = prvBuild(fill,pick,0,inOrder.size(),prvBlackLevels(inOrder.size()));
+    }
+
+    // number of black levels in a tree built over n keys
+    static uint32_t prvBlackLevels(uint32_t n) {
+        uint32_t
+            h = 0;
+
+        while (h < 32 && ((uint64_t)2 << h) - 1 <= n)
+            h++;
+
+        return h;
+    }
+
+    //
+    // build a subtree over sorted positions [lo,lo+n) with h black levels. a subtree
+    // with h black levels holds between 2^h-1 (all 2-nodes) and 3^h-1 (all 3-nodes)
+    // keys; a 2-node is used whenever both halves still fit, so the 3-nodes (a black
+    // node with a red left child) gather near the bottom. position p goes to node
+    // pick(p), which is asked for positions in preorder. nodes are filled in key
+    // order, so the pairs can come straight from a stream. while forks lasts, the
+    // leftmost subtree of a big enough node is built on a thread of its own; the
+    // subtrees cover disjoint positions, so pick must then hand out fixed nodes (a
+    // run, say) rather than allocate them
+    //
+
+    template <typename Fill,typename Pick>
+    uint32_t prvBuild(Fill &fill,Pick &pick,uint32_t lo,uint32_t n,uint32_t h,uint32_t forks=0) {
+        uint64_t
+            maxBelow = 1;
+        uint32_t
+            a,b,c,x,y,
+            next = (forks > 0) ? forks - 1 : 0;
+        bool
+            fork = forks > 0 && n >= BUILD_PARALLEL_CUTOFF;
+
+        if (n == 0)
+            return NULL_INDEX;
+
+        REPI(i,1,h)
+            maxBelow *= 3;
+        maxBelow--;
+
+        if (n - 1 <= 2 * maxBelow) {
+            // 2-node
+            a = n / 2;
+            b = n - 1 - a;
+
+            y = pick(lo + a);
+
+            prvFork(fork,[&]() { left(y) = prvBuild(fill,pick,lo,a,h-1,next); },
+                    [&]() {
+                        fill(y,lo + a);
+                        right(y) = prvBuild(fill,pick,lo+a+1,b,h-1,next);
+                    });
+        } else {
+            // 3-node
+            a = (n - 2 + 2) / 3;
+            b = (n - 2 + 1) / 3;
+            c = n - 2 - a - b;
+
+            x = pick(lo + a);
+            y = pick(lo + a + b + 1);
+
+            prvFork(fork,[&]() { left(x) = prvBuild(fill,pick,lo,a,h-1,next); },
+                    [&]() {
+                        fill(x,lo + a);
+                        right(x) = prvBuild(fill,pick,lo+a+1,b,h-1,next);
+                        fill(y,lo + a + b + 1);
+                        right(y) = prvBuild(fill,pick,lo+a+b+2,c,h-1,next);
+                    });
+            setColor(x,NODE_RED);
+            prvAdjust(x);
+
+            left(y) = x;
         }
+
+        setColor(y,NODE_BLACK);
+        prvAdjust(y);
+
+        return y;
     }
 
-    void prvAdjust(uint32_t r) {
+    // levels of a binary fork tree whose leaves keep nThreads threads busy
+    static uint32_t prvForkLevels(uint32_t nThreads) {
         uint32_t
-            lc = GET_COUNT(left[r]),
-            rc = GET_COUNT(right[r]),
-            lh = GET_HEIGHT(left[r]),
-            rh = GET_HEIGHT(right[r]);
+            levels = 0;
+
+        while (levels < 31 && ((uint64_t)2 << levels) <= nThreads)
+            levels++;
 
-        counts[r] = 1 + lc + rc;
-        heights[r] = 1 + ((lh > rh) ? lh : rh);
+        return levels;
     }
 
+    // run first and then second, or both at once with first on a thread of its own if
+    // fork is set. the pool is not thread safe, so the two must not allocate or free
+    // nodes. if no thread can be had, first runs here after all
+    template <typename First,typename Second>
+    static void prvFork(bool fork,First &&first,Second &&second) {
+        std::thread
+            t;
+
+        if (fork)
+            try {
+                t = std::thread(first);
+            } catch (const std::system_error &) {
+            }
+
+        if (!t.joinable())
+            first();
+        second();
+
+        if (t.joinable())
+            t.join();
+    }
+
+    void prvAdjust(uint32_t r) { setCount(r,1 + GET_COUNT(left(r)) + GET_COUNT(right(r))); }
+
     uint32_t prvRotateLeft(uint32_t r) {
         uint32_t
-            s = right[r];
+            s = right(r);
 
-        right[r] = left[s];
-        left[s] = r;
+        right(r) = left(s);
+        left(s) = r;
 
-        colors[s] = colors[r];
-        colors[r] = NODE_RED;
+        setColor(s,colors(r));
+        setColor(r,NODE_RED);
 
         prvAdjust(r);
         prvAdjust(s);
@@ -269,13 +1701,13 @@ private:
 
     uint32_t prvRotateRight(uint32_t r) {
         uint32_t
-            q = left[r];
+            q = left(r);
 
-        left[r] = right[q];
-        right[q] = r;
+        left(r) = right(q);
+        right(q) = r;
 
-        colors[q] = colors[r];
-        colors[r] = NODE_RED;
+        setColor(q,colors(r));
+        setColor(r,NODE_RED);
 
         prvAdjust(r);
         prvAdjust(q);
@@ -285,18 +1717,18 @@ private:
 
     void prvFlipColors(uint32_t r) {
 
-        colors[r] = !colors[r];
-        colors[left[r]] = !colors[left[r]];
-        colors[right[r]] = !colors[right[r]];
+        pool->countAndColor(r) ^= COLOR_BIT;
+        pool->countAndColor(left(r)) ^= COLOR_BIT;
+        pool->countAndColor(right(r)) ^= COLOR_BIT;
     }
 
     uint32_t prvBalance(uint32_t r) {
 
-        if (IS_RED(right[r]) && !IS_RED(left[r]))
+        if (IS_RED(right(r)) && !IS_RED(left(r)))
             r = prvRotateLeft(r);
-        if (IS_RED(left[r]) && IS_RED(left[left[r]]))
+        if (IS_RED(left(r)) && IS_RED(left(left(r))))
             r = prvRotateRight(r);
-        if (IS_RED(left[r]) && IS_RED(right[r]))
+        if (IS_RED(left(r)) && IS_RED(right(r)))
             prvFlipColors(r);
 
         prvAdjust(r);
@@ -307,8 +1739,8 @@ private:
     uint32_t prvMoveRedLeft(uint32_t r) {
 
         prvFlipColors(r);
-        if (IS_RED(left[right[r]])) {
-            right[r] = prvRotateRight(right[r]);
+        if (IS_RED(left(right(r)))) {
+            right(r) = prvRotateRight(right(r));
             r = prvRotateLeft(r);
             prvFlipColors(r);
         }
@@ -319,7 +1751,7 @@ private:
     uint32_t prvMoveRedRight(uint32_t r) {
 
         prvFlipColors(r);
-        if (IS_RED(left[left[r]])) {
+        if (IS_RED(left(left(r)))) {
             r = prvRotateRight(r);
             prvFlipColors(r);
         }
@@ -327,81 +1759,431 @@ private:
         return r;
     }
 
-    uint32_t prvInsert(uint32_t r,const KeyType &k) {
-        uint32_t
-            tmp;
+    //
+    // the update paths walk down iteratively, recording each node they leave along with
+    // the side they took, then unwind that path bottom-up, relinking and rebalancing each
+    // node exactly as the recursive versions did on their way back out. An LLRB tree is
+    // never more than 2 lg n deep, so a fixed-size path always suffices.
+    //
 
-        if (r == NULL_INDEX) {
-            tmp = prvAllocate();
+    uint32_t prvUnwind(uint32_t *path,bool *wentLeft,uint32_t depth,uint32_t child) {
 
-            keys[tmp] = k;
+        while (depth > 0) {
+            depth--;
 
-            return tmp;
+            if (wentLeft[depth])
+                left(path[depth]) = child;
+            else
+                right(path[depth]) = child;
+
+            child = prvBalance(path[depth]);
         }
 
-        if (k == keys[r])
-            return r;
+        return child;
+    }
 
-        if (k < keys[r]) {
-            // why split these? because left might change inside prvInsert
-            // so must guarantee proper order
-            tmp = prvInsert(left[r],k);
-            left[r] = tmp;
-        } else {
-            tmp = prvInsert(right[r],k);
-            right[r] = tmp;
-        }
+    template <typename K,typename... Args>
+    bool prvEmplace(K &&k,Args &&...args) {
+        bool
+            isNew;
+        uint32_t
+            node = prvUpsert(std::forward<K>(k),isNew);
 
-        return prvBalance(r);
+        if (isNew)
+            values(node) = ValueType(std::forward<Args>(args)...);
+
+        return isNew;
     }
 
-    uint32_t prvRemoveMin(uint32_t r,uint32_t &ntbd) {
+    template <typename K,typename V>
+    bool prvAssign(K &&k,V &&v) {
+        bool
+            isNew;
 
-        if (left[r] == NULL_INDEX) {
-            ntbd = r;
+        values(prvUpsert(std::forward<K>(k),isNew)) = std::forward<V>(v);
 
-            return NULL_INDEX;
+        return isNew;
+    }
+
+    // insert k if needed, in a single descent; node is set to the index holding k.
+    // rotations relink nodes rather than move keys, so node survives the rebalancing
+    template <typename K>
+    uint32_t prvUpsert(K &&k,bool &isNew) {
+        uint32_t
+            node;
+
+        root = prvInsert(root,std::forward<K>(k),node,isNew);
+
+        setColor(root,NODE_BLACK);
+
+        return node;
+    }
+
+    template <typename K>
+    uint32_t prvInsert(uint32_t r,K &&k,uint32_t &node,bool &isNew) {
+        uint32_t
+            path[RB_MAX_DEPTH],
+            depth = 0;
+        bool
+            wentLeft[RB_MAX_DEPTH];
+
+        while (r != NULL_INDEX) {
+            // already here? nothing on the path changes
+            if (k == keys(r)) {
+                node = r;
+                isNew = false;
+                return root;
+            }
+
+            path[depth] = r;
+            wentLeft[depth] = k < keys(r);
+            r = wentLeft[depth] ? left(r) : right(r);
+            depth++;
         }
 
-        if (!IS_RED(left[r]) && !IS_RED(left[left[r]]))
-            r = prvMoveRedLeft(r);
+        node = prvAllocate();
+        isNew = true;
 
-        left[r] = prvRemoveMin(left[r],ntbd);
+        keys(node) = std::forward<K>(k);
 
-        return prvBalance(r);
+        return prvUnwind(path,wentLeft,depth,node);
     }
 
+    // ntbd is set to the detached node, or NULL_INDEX if k is not in the tree. a miss
+    // is only found at the bottom, after the descent has already pushed red links down;
+    // the unwind restores the invariants either way.
+    //
+    // a node with two children is not overwritten with its successor's contents: the
+    // successor node itself is spliced into its place, so no key or value moves and
+    // every surviving element keeps its index
     uint32_t prvRemove(uint32_t r,uint32_t &ntbd,const KeyType &k) {
+        uint32_t
+            path[RB_MAX_DEPTH],
+            depth = 0,
+            matchDepth = 0;
+        bool
+            wentLeft[RB_MAX_DEPTH],
+            removingMin = false;
+
+        while (true) {
+            if (removingMin || k < keys(r)) {
+                if (left(r) == NULL_INDEX) {
+                    // the minimum has no left child (so no children at all); it leaves
+                    // its spot and takes over the matched node's links and color
+                    if (removingMin) {
+                        ntbd = path[matchDepth];
+                        left(r) = left(ntbd);
+                        right(r) = right(ntbd);
+                        setColor(r,colors(ntbd));
+                        path[matchDepth] = r;
+                        return prvUnwind(path,wentLeft,depth,NULL_INDEX);
+                    }
+                    ntbd = NULL_INDEX;
+                    return prvUnwind(path,wentLeft,depth,r);
+                }
+                if (!IS_RED(left(r)) && !IS_RED(left(left(r))))
+                    r = prvMoveRedLeft(r);
+                path[depth] = r;
+                wentLeft[depth++] = true;
+                r = left(r);
+            } else {
+                if (IS_RED(left(r)))
+                    r = prvRotateRight(r);
+                if (right(r) == NULL_INDEX) {
+                    if (k == keys(r)) {
+                        ntbd = r;
+                        return prvUnwind(path,wentLeft,depth,NULL_INDEX);
+                    }
+                    ntbd = NULL_INDEX;
+                    return prvUnwind(path,wentLeft,depth,r);
+                }
+                if (!IS_RED(right(r)) && !IS_RED(left(right(r))))
+                    r = prvMoveRedRight(r);
+                // from here on, remove the minimum of the right subtree; it will
+                // replace r
+                if (k == keys(r)) {
+                    matchDepth = depth;
+                    removingMin = true;
+                }
+                path[depth] = r;
+                wentLeft[depth++] = false;
+                r = right(r);
+            }
+        }
+    }
+
+    const KeyType &prvMinKey(uint32_t r) {
+
+        while (left(r) != NULL_INDEX)
+            r = left(r);
+
+        return keys(r);
+    }
+
+    const KeyType &prvMaxKey(uint32_t r) {
+
+        while (right(r) != NULL_INDEX)
+            r = right(r);
+
+        return keys(r);
+    }
 
-        if (k < keys[r]) {
-            if (!IS_RED(left[r]) && !IS_RED(left[left[r]]))
-                r = prvMoveRedLeft(r);
-            left[r] = prvRemove(left[r],ntbd,k);
+    // black nodes on every path from r down to a leaf
+    uint32_t prvBlackHeight(uint32_t r) {
+        uint32_t
+            h = 0;
+
+        for (;r!=NULL_INDEX;r=left(r))
+            if (!IS_RED(r))
+                h++;
+
+        return h;
+    }
+
+    //
+    // join subtrees a and b, with black heights ha and hb, around the detached node m;
+    // every key of a must be less than m's and every key of b greater. the taller
+    // subtree is walked down along the side facing the other -- its right spine for a,
+    // its left spine for b -- to the first black node c whose black height matches the
+    // shorter one. m, colored red, takes c's place with c and the shorter subtree as its
+    // children, and the path is unwound just as for an insertion: m is a red link hung
+    // at the right black level, exactly like a new leaf one level up. the cost is the
+    // difference in black heights, plus one.
+    //
+    // the root that comes back may be red; h is set to its black height
+    //
+    uint32_t prvJoin(uint32_t a,uint32_t ha,uint32_t m,uint32_t b,uint32_t hb,uint32_t &h) {
+        uint32_t
+            path[RB_MAX_DEPTH],
+            depth = 0,
+            r;
+        bool
+            wentLeft[RB_MAX_DEPTH];
+
+        // red roots are blackened, which adds a black level
+        if (IS_RED(a)) {
+            setColor(a,NODE_BLACK);
+            ha++;
+        }
+        if (IS_RED(b)) {
+            setColor(b,NODE_BLACK);
+            hb++;
+        }
+
+        setColor(m,NODE_RED);
+        h = std::max(ha,hb);
+
+        if (ha >= hb) {
+            // a's right spine is all black, one level per step
+            for (r=a;ha>hb;ha--) {
+                path[depth] = r;
+                wentLeft[depth++] = false;
+                r = right(r);
+            }
+            left(m) = r;
+            right(m) = b;
         } else {
-            if (IS_RED(left[r]))
-                r = prvRotateRight(r);
-            if (k == keys[r] && right[r] == NULL_INDEX) {
-                ntbd = r;
-                return NULL_INDEX;
+            for (r=b;hb>ha || IS_RED(r);) {
+                if (!IS_RED(r))
+                    hb--;
+                path[depth] = r;
+                wentLeft[depth++] = true;
+                r = left(r);
             }
-            if (!IS_RED(right[r]) && !IS_RED(left[right[r]]))
-                r = prvMoveRedRight(r);
-            if (k == keys[r]) {
-                uint32_t
-                    tmp = right[r];
+            left(m) = a;
+            right(m) = r;
+        }
 
-                while (left[tmp] != NULL_INDEX)
-                    tmp = left[tmp];
+        prvAdjust(m);
 
-                keys[r] = keys[tmp];
-                values[r] = values[tmp];
 
-                right[r] = prvRemoveMin(right[r],ntbd);
-            } else
-                right[r] = prvRemove(right[r],ntbd,k);
+        return prvUnwind(path,wentLeft,depth,m);
+    }
+
+    //
+    // split the subtree at r, with black height h, into the keys less than k (at less,
+    // with black height hLess) and the rest (at ge, hGe). r goes to one side and its
+    // subtree on that side goes with it whole; the other side is split recursively and
+    // joined to it around r. the black heights of the pieces only grow on the way back
+    // up, so the joins cost O(log n) between them.
+    //
+    // given eq, a node holding k is detached rather than put in ge: *eq is set to it,
+    // or to NULL_INDEX if there is none. its links are left as they were
+    //
+    void prvSplit(uint32_t r,uint32_t h,const KeyType &k,uint32_t &less,uint32_t &hLess,uint32_t &ge,uint32_t &hGe,
+                  uint32_t *eq=nullptr) {
+        uint32_t
+            hChild,
+            lo,
+            hLo,
+            hi,
+            hHi;
+
+        if (r == NULL_INDEX) {
+            less = ge = NULL_INDEX;
+            hLess = hGe = 0;
+            if (eq != nullptr)
+                *eq = NULL_INDEX;
+            return;
+        }
+
+        hChild = IS_RED(r) ? h : h - 1;
+
+        if (eq != nullptr && k == keys(r)) {
+            less = left(r);
+            ge = right(r);
+            hLess = hGe = hChild;
+            *eq = r;
+        } else if (keys(r) < k) {
+            prvSplit(right(r),hChild,k,lo,hLo,ge,hGe,eq);
+            less = prvJoin(left(r),hChild,r,lo,hLo,hLess);
+        } else {
+            prvSplit(left(r),hChild,k,less,hLess,hi,hHi,eq);
+            ge = prvJoin(hi,hHi,r,right(r),hChild,hGe);
+        }
+    }
+
+    // join subtrees a and b, with a's black height ha, with no node between them; b's
+    // smallest node is detached to stand in the middle
+    uint32_t prvConcat(uint32_t a,uint32_t ha,uint32_t b,uint32_t &h) {
+        uint32_t
+            m;
+
+        if (b == NULL_INDEX) {
+            h = ha;
+            return a;
+        }
+        if (a == NULL_INDEX) {
+            h = prvBlackHeight(b);
+            return b;
+        }
+
+        if (!IS_RED(left(b)) && !IS_RED(right(b)))
+            setColor(b,NODE_RED);
+        b = prvRemove(b,m,prvMinKey(b));
+        if (b != NULL_INDEX)
+            setColor(b,NODE_BLACK);
+
+        return prvJoin(a,ha,m,b,prvBlackHeight(b),h);
+    }
+
+    //
+    // the set operations, join-based: split b around the root of a, combine a's left
+    // subtree with the keys of b below it and a's right subtree with those above, then
+    // join the two results around a's root (taking the value of b's node holding the
+    // same key, if there is one) or around nothing, as the operation dictates; b's
+    // node for a shared key is always discarded. the two combinations touch
+    // disjoint nodes and neither allocates nor frees one, so they can run on separate
+    // threads: one on a new thread, one on this, while forks lasts and there are
+    // SET_OP_PARALLEL_CUTOFF keys or more between a and b. the nodes neither side keeps
+    // are left for the caller to free, as roots of subtrees gathered in garbage
+    //
+
+    enum SetOp {
+        SET_UNION,
+        SET_INTERSECTION,
+        SET_DIFFERENCE
+    };
+
+    void prvCombine(SetOp op,RedBlackTree &other,uint32_t nThreads,const char *name) {
+        std::vector<uint32_t>
+            garbage;
+        uint32_t
+            a = root,
+            b = other.root,
+            h;
+
+        if (other.pool != pool)
+            throw std::invalid_argument(std::string(name) + ": trees do not share a pool");
+        if (&other == this)
+            throw std::invalid_argument(std::string(name) + ": a tree cannot be combined with itself");
+
+        root = other.root = NULL_INDEX;
+
+        root = prvCombine(op,a,prvBlackHeight(a),b,prvBlackHeight(b),prvForkLevels(nThreads),garbage,h);
+        if (root != NULL_INDEX)
+            setColor(root,NODE_BLACK);
+
+        for (uint32_t r : garbage)
+            prvClear(r);
+    }
+
+    uint32_t prvCombine(SetOp op,uint32_t a,uint32_t ha,uint32_t b,uint32_t hb,uint32_t forks,
+                        std::vector<uint32_t> &garbage,uint32_t &h) {
+        uint32_t
+            hChild,
+            below,
+            hBelow,
+            above,
+            hAbove,
+            eq,
+            l,
+            hl,
+            r,
+            hr,
+            al,
+            ar,
+            next = (forks > 0) ? forks - 1 : 0;
+        bool
+            fork;
+        std::vector<uint32_t>
+            theirGarbage;
+
+        if (a == NULL_INDEX || b == NULL_INDEX) {
+            if (op == SET_UNION || (op == SET_DIFFERENCE && b == NULL_INDEX)) {
+                h = (a == NULL_INDEX) ? hb : ha;
+                return (a == NULL_INDEX) ? b : a;
+            }
+
+            if (a != NULL_INDEX || b != NULL_INDEX)
+                garbage.push_back((a == NULL_INDEX) ? b : a);
+            h = 0;
+            return NULL_INDEX;
         }
 
-        return prvBalance(r);
+        fork = forks > 0 && GET_COUNT(a) + GET_COUNT(b) >= SET_OP_PARALLEL_CUTOFF;
+        hChild = IS_RED(a) ? ha : ha - 1;
+        al = left(a);
+        ar = right(a);
+
+        prvSplit(b,hb,keys(a),below,hBelow,above,hAbove,&eq);
+
+        // a forked half gathers its garbage apart, to be added to ours after
+        prvFork(fork,[&]() { l = prvCombine(op,al,hChild,below,hBelow,next,fork ? theirGarbage : garbage,hl); },
+                [&]() { r = prvCombine(op,ar,hChild,above,hAbove,next,garbage,hr); });
+        garbage.insert(garbage.end(),theirGarbage.begin(),theirGarbage.end());
+
+        switch (op) {
+            case SET_UNION:
+                if (eq != NULL_INDEX) {
+                    values(a) = std::move(values(eq));
+                    prvDiscard(eq,garbage);
+                }
+                return prvJoin(l,hl,a,r,hr,h);
+
+            case SET_INTERSECTION:
+                if (eq == NULL_INDEX) {
+                    prvDiscard(a,garbage);
+                    return prvConcat(l,hl,r,h);
+                }
+                values(a) = std::move(values(eq));
+                prvDiscard(eq,garbage);
+                return prvJoin(l,hl,a,r,hr,h);
+
+            default:
+                if (eq == NULL_INDEX)
+                    return prvJoin(l,hl,a,r,hr,h);
+                prvDiscard(a,garbage);
+                prvDiscard(eq,garbage);
+                return prvConcat(l,hl,r,h);
+        }
+    }
+
+    // set aside a single detached node for freeing
+    void prvDiscard(uint32_t r,std::vector<uint32_t> &garbage) {
+
+        left(r) = right(r) = NULL_INDEX;
+        garbage.push_back(r);
     }
 
     void prvIsValid(uint32_t r,uint32_t &leafDepth,uint32_t curDepth) {
@@ -416,69 +2198,33 @@ private:
             return;
         }
 
-        if (IS_RED(r) && (IS_RED(left[r])) || IS_RED(right[r]))
+        if (IS_RED(r) && (IS_RED(left(r))) || IS_RED(right(r)))
             throw std::logic_error("red rule violation");
 
-        if (left[r] != NULL_INDEX && keys[left[r]] >= keys[r])
+        if (left(r) != NULL_INDEX && keys(left(r)) >= keys(r))
             throw std::logic_error("left child not less");
 
-        if (right[r] != NULL_INDEX && keys[right[r]] <= keys[r])
+        if (right(r) != NULL_INDEX && keys(right(r)) <= keys(r))
             throw std::logic_error("right child not larger");
 
-        prvIsValid(left[r],leafDepth,curDepth+(IS_RED(r) ? 0 : 1));
-        prvIsValid(right[r],leafDepth,curDepth+(IS_RED(r) ? 0 : 1));
+        prvIsValid(left(r),leafDepth,curDepth+(IS_RED(r) ? 0 : 1));
+        prvIsValid(right(r),leafDepth,curDepth+(IS_RED(r) ? 0 : 1));
     }
 
     uint32_t
         root;
 
-    [[maybe_unused]] static uint32_t
-        *left,
-        *right,
-        *counts,
-        *heights,
-        nTrees,
-        freeListHead,
-        capacity;
-
-    static uint8_t
-        *colors;
+    NodePool<KeyType,ValueType,Layout>
+        *pool;
 
-    [[maybe_unused]] static KeyType
-        *keys;
+    bool
+        ownsPool;
 
-    [[maybe_unused]] static ValueType
-        *values;
+    static NodePool<KeyType,ValueType,Layout>
+        *sharedPool;
 };
 
-template <typename KeyType,typename ValueType>
-uint32_t RedBlackTree<KeyType,ValueType>::capacity = 0;
-
-template <typename KeyType,typename ValueType>
-uint32_t RedBlackTree<KeyType,ValueType>::freeListHead = 0;
-
-template <typename KeyType,typename ValueType>
-uint32_t RedBlackTree<KeyType,ValueType>::nTrees = 0;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::left = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::right = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::counts = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint32_t *RedBlackTree<KeyType,ValueType>::heights = nullptr;
-
-template <typename KeyType,typename ValueType>
-uint8_t *RedBlackTree<KeyType,ValueType>::colors = nullptr;
-
-template <typename KeyType,typename ValueType>
-KeyType *RedBlackTree<KeyType,ValueType>::keys = nullptr;
-
-template <typename KeyType,typename ValueType>
-ValueType *RedBlackTree<KeyType,ValueType>::values = nullptr;
+template <typename KeyType,typename ValueType,typename Layout>
+NodePool<KeyType,ValueType,Layout> *RedBlackTree<KeyType,ValueType,Layout>::sharedPool = nullptr;
 
 #endif //REDBLACKTREE_H
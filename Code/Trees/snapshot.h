@@ -0,0 +1,363 @@
+//
+// snapshot.h
+//      the stream format behind RedBlackTree and SortedLinearList saveTo()/loadFrom()
+//
+// A snapshot is a 16-byte header followed by the tree's contents in key order:
+//
+//      "TRSN", version, flags, key bytes, value bytes, count (8 bytes)
+//      then for each entry its key, then its value (a SortedLinearList has none)
+//
+// A key is stored as its raw bytes or, in a delta-encoded snapshot, as its difference
+// from the key before it (the first from zero) in a LEB128 varint: seven bits a byte,
+// the high bit set on every byte but the last. Sorted integer keys that lie close
+// together take a byte or two each instead of eight. Values are always raw. Raw bytes
+// are in host byte order, so a snapshot moves only between machines of the same
+// endianness, and keys and values must be trivially copyable.
+//
+// Both ends go through a fixed-size buffer and never hold more than one entry of their
+// own, so saving or loading takes the same extra memory whatever the size of the tree.
+//
+// The count in the header is not taken on trust: every entry takes at least a byte of
+// key plus its value, so a stream that can seek must have that many bytes left for
+// all of them. A stream that cannot seek has no such check, and its entries have to
+// be read before anything is sized by the count.
+//
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+static const uint32_t
+    SNAPSHOT_BUFFER_BYTES = 1 << 16,
+    SNAPSHOT_VERSION = 1,
+    SNAPSHOT_DELTA = 1;                 // flag: keys are delta encoded
+
+static const char
+    SNAPSHOT_MAGIC[4] = {'T','R','S','N'};
+
+// can keys of this type be delta encoded?
+template <typename KeyType>
+constexpr bool snapshotCanDelta() {
+
+    return std::is_integral<KeyType>::value && !std::is_same<KeyType,bool>::value;
+}
+
+// the unsigned type a key's delta is taken in; wrapping arithmetic there gives the
+// right difference for signed keys too
+template <typename KeyType,bool = snapshotCanDelta<KeyType>()>
+struct SnapshotBits {
+    typedef uint64_t Type;
+};
+
+template <typename KeyType>
+struct SnapshotBits<KeyType,true> {
+    typedef typename std::make_unsigned<KeyType>::type Type;
+};
+
+template <typename KeyType>
+class SnapshotWriter {
+    static_assert(std::is_trivially_copyable<KeyType>::value,"snapshots need trivially copyable keys");
+public:
+    // start a snapshot of count entries on os, with valueBytes of value after each key.
+    // throws invalid_argument if delta is asked of a key type that cannot have it
+    SnapshotWriter(std::ostream &_os,bool _delta,uint32_t valueBytes,uint64_t count) :
+        os(_os),buf(SNAPSHOT_BUFFER_BYTES),used(0),delta(_delta),prev(0) {
+        uint8_t
+            fields[4] = {(uint8_t)SNAPSHOT_VERSION,(uint8_t)(delta ? SNAPSHOT_DELTA : 0),
+                         (uint8_t)sizeof(KeyType),(uint8_t)valueBytes};
+
+        if (delta && !snapshotCanDelta<KeyType>())
+            throw std::invalid_argument("saveTo: only integer keys can be delta encoded");
+
+        prvPut(SNAPSHOT_MAGIC,sizeof(SNAPSHOT_MAGIC));
+        prvPut(fields,sizeof(fields));
+        prvPut(&count,sizeof(count));
+    }
+
+    void putKey(const KeyType &k) {
+
+        if constexpr (snapshotCanDelta<KeyType>())
+            if (delta) {
+                typename SnapshotBits<KeyType>::Type
+                    bits = k;
+
+                prvPutVarint((uint64_t)(typename SnapshotBits<KeyType>::Type)(bits - prev));
+                prev = bits;
+                return;
+            }
+
+        prvPut(&k,sizeof(k));
+    }
+
+    template <typename ValueType>
+    void putValue(const ValueType &v) {
+        static_assert(std::is_trivially_copyable<ValueType>::value,"snapshots need trivially copyable values");
+
+        prvPut(&v,sizeof(v));
+    }
+
+    // write out what is buffered; throws runtime_error if the stream has failed
+    void finish() {
+
+        prvFlush();
+        os.flush();
+        if (!os)
+            throw std::runtime_error("saveTo: write failed");
+    }
+
+private:
+    void prvFlush() {
+
+        os.write(buf.data(),used);
+        used = 0;
+    }
+
+    void prvPut(const void *p,size_t n) {
+
+        if (used + n > buf.size())
+            prvFlush();
+        memcpy(buf.data() + used,p,n);
+        used += n;
+    }
+
+    void prvPutVarint(uint64_t x) {
+        uint8_t
+            bytes[10];
+        size_t
+            n = 0;
+
+        while (x >= 0x80) {
+            bytes[n++] = (uint8_t)(x | 0x80);
+            x >>= 7;
+        }
+        bytes[n++] = (uint8_t)x;
+
+        prvPut(bytes,n);
+    }
+
+    std::ostream
+        &os;
+
+    std::vector<char>
+        buf;
+
+    size_t
+        used;
+
+    bool
+        delta;
+
+    typename SnapshotBits<KeyType>::Type
+        prev;
+};
+
+//
+// reading does not throw once the header has been accepted: a tree is built as the
+// entries arrive, and stopping part way would leave it half built. a reader that
+// runs out of data or finds keys out of order instead remembers the problem and
+// hands out zeros; finish() reports it once the tree is whole
+//
+
+template <typename KeyType>
+class SnapshotReader {
+    static_assert(std::is_trivially_copyable<KeyType>::value,"snapshots need trivially copyable keys");
+public:
+    // read and check the header of a snapshot on is, whose entries must carry valueBytes
+    // of value each and come in increasing key order (strictly so if strict). throws
+    // invalid_argument if the header is not one such a snapshot would have, or if the
+    // stream can seek and is too short to hold as many entries as the header says
+    SnapshotReader(std::istream &_is,uint32_t valueBytes,bool _strict) :
+        is(_is),buf(SNAPSHOT_BUFFER_BYTES),used(0),filled(0),strict(_strict),checked(false),nRead(0),bits(0) {
+        char
+            magic[sizeof(SNAPSHOT_MAGIC)];
+        uint8_t
+            fields[4];
+
+        if (!is.read(magic,sizeof(magic)) || !is.read((char *)fields,sizeof(fields)) ||
+            !is.read((char *)&count,sizeof(count)) || memcmp(magic,SNAPSHOT_MAGIC,sizeof(magic)) != 0)
+            throw std::invalid_argument("loadFrom: not a snapshot");
+        if (fields[0] != SNAPSHOT_VERSION)
+            throw std::invalid_argument("loadFrom: unknown snapshot version");
+        if (fields[2] != sizeof(KeyType) || fields[3] != valueBytes)
+            throw std::invalid_argument("loadFrom: snapshot holds other key or value types");
+
+        delta = (fields[1] & SNAPSHOT_DELTA) != 0;
+        if (delta && !snapshotCanDelta<KeyType>())
+            throw std::invalid_argument("loadFrom: delta-encoded snapshot of non-integer keys");
+
+        prvCheckCount((delta ? 1 : sizeof(KeyType)) + valueBytes);
+    }
+
+    uint64_t size() { return count; }
+
+    // was size() checked against the length of the stream?
+    bool sizeChecked() { return checked; }
+
+    // has anything gone wrong since the header?
+    bool failed() { return !error.empty(); }
+
+    void getKey(KeyType &k) {
+
+        if constexpr (snapshotCanDelta<KeyType>())
+            if (delta) {
+                bits += (typename SnapshotBits<KeyType>::Type)prvGetVarint();
+                k = (KeyType)bits;
+                prvCheckOrder(k);
+                return;
+            }
+
+        prvGet(&k,sizeof(k));
+        prvCheckOrder(k);
+    }
+
+    template <typename ValueType>
+    void getValue(ValueType &v) {
+        static_assert(std::is_trivially_copyable<ValueType>::value,"snapshots need trivially copyable values");
+
+        prvGet(&v,sizeof(v));
+    }
+
+    // give back what was read past the end of the snapshot, if the stream can seek,
+    // and throw invalid_argument if anything went wrong since the header
+    void finish() {
+
+        if (used < filled) {
+            is.clear();
+            is.seekg(-(std::streamoff)(filled - used),std::ios_base::cur);
+        }
+
+        if (!error.empty())
+            throw std::invalid_argument("loadFrom: " + error);
+    }
+
+private:
+    // if the stream can seek, make sure what is left of it can hold count entries of
+    // at least minBytes each, and leave it where it was
+    void prvCheckCount(uint64_t minBytes) {
+        std::streampos
+            here = is.tellg(),
+            end;
+
+        if (here == std::streampos(-1) || !is.seekg(0,std::ios_base::end)) {
+            is.clear();
+            return;
+        }
+        end = is.tellg();
+        is.seekg(here);
+        if (end == std::streampos(-1) || !is)
+            throw std::invalid_argument("loadFrom: snapshot stream lost its place");
+
+        if (count > (uint64_t)(end - here) / minBytes)
+            throw std::invalid_argument("loadFrom: snapshot is truncated");
+
+        checked = true;
+    }
+
+    void prvFail(const char *what) {
+
+        if (error.empty())
+            error = what;
+    }
+
+    void prvCheckOrder(const KeyType &k) {
+
+        if (nRead++ > 0 && (strict ? !(prev < k) : k < prev))
+            prvFail("keys out of order");
+        prev = k;
+    }
+
+    // refill the buffer; false at the end of the stream
+    bool prvFill() {
+
+        if (!error.empty())
+            return false;
+
+        is.read(buf.data(),buf.size());
+        filled = is.gcount();
+        used = 0;
+        if (filled == 0)
+            prvFail("snapshot is truncated");
+
+        return filled > 0;
+    }
+
+    void prvGet(void *p,size_t n) {
+        char
+            *out = static_cast<char *>(p);
+
+        while (n > 0) {
+            if (used == filled && !prvFill()) {
+                memset(out,0,n);
+                return;
+            }
+
+            size_t
+                m = std::min(n,filled - used);
+
+            memcpy(out,buf.data() + used,m);
+            used += m;
+            out += m;
+            n -= m;
+        }
+    }
+
+    uint64_t prvGetVarint() {
+        uint64_t
+            x = 0;
+
+        for (uint32_t shift=0;shift<64;shift+=7) {
+            if (used == filled && !prvFill())
+                return 0;
+
+            uint8_t
+                byte = buf[used++];
+
+            x |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return x;
+        }
+
+        prvFail("bad varint");
+
+        return 0;
+    }
+
+    std::istream
+        &is;
+
+    std::vector<char>
+        buf;
+
+    size_t
+        used,
+        filled;
+
+    bool
+        delta,
+        strict,
+        checked;
+
+    uint64_t
+        count,
+        nRead;
+
+    typename SnapshotBits<KeyType>::Type
+        bits;
+
+    KeyType
+        prev;
+
+    std::string
+        error;
+};
+
+#endif //SNAPSHOT_H